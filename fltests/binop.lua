@@ -41,3 +41,17 @@ local a = 0.5
 for i = 0, 100 do a = a + 1 end
 print(a)
 end
+
+do
+print('sub r k')
+local a = 0
+for i = 0, 100 do a = a - 2 end
+print(a)
+end
+
+do
+print('mul r r')
+local a, b = 1, 1.5
+for i = 0, 30 do a = a * b end
+print(a)
+end
@@ -0,0 +1,73 @@
+if jit and jit.logger then jit.logger('none') end
+
+print('and, or, xor')
+do
+local a, b, c = 0, 0, 0
+for i = 1, 300 do
+  a = a + (i & 0xF0)
+  b = b ~ (i | a)
+  c = (c + i * 31) & 0xFFFFFF
+end
+print(a, b, c)
+local x = -1
+for i = 1, 200 do x = x & ~i end
+print(x)
+end
+
+print('-----------------------------------------------------------------------')
+
+print('constant shifts')
+do
+local a, b, c, d = 0, 0, 0, 0
+for i = 1, 200 do
+  a = a + (i << 3) + (i >> 1)
+  b = b ~ (i << 63) ~ ((0 - i) >> 60)
+  c = c + (i << 64) + (i >> 64) + (i << -2) + (i >> -2)
+  d = d + (-1 >> 1 >> 62)
+end
+print(a, b, c, d)
+end
+
+print('-----------------------------------------------------------------------')
+
+print('variable shifts')
+do
+local a, b = 0, 0
+for i = -70, 70 do
+  a = a ~ (0x123456789 << i)
+  b = b + (-1 >> i) + (1 << (i * 2))
+end
+print(a, b)
+end
+
+print('-----------------------------------------------------------------------')
+
+print('hash mixing')
+do
+local byte = string.byte
+local s = string.rep('the quick brown fox ', 20)
+local h = 5381
+for i = 1, #s do
+  h = ((h << 5) + h + byte(s, i)) & 0xFFFFFFFF
+end
+local crc = 0xFFFFFFFF
+for i = 1, #s do
+  crc = (crc >> 8) ~ ((crc ~ byte(s, i)) & 0xFF) * 0x01000193
+end
+print(h, crc)
+end
+
+print('-----------------------------------------------------------------------')
+
+print('mixed number types')
+do
+local n = 0
+for i = 1, 300 do
+  local v = i
+  if i > 150 then v = i + 0.0 end
+  n = n + (v | 1) + (v >> 1)
+end
+print(n)
+end
+
+print('-----------------------------------------------------------------------')
@@ -0,0 +1,112 @@
+if jit and jit.logger then jit.logger('none') end
+
+print('string.byte')
+do
+local byte = string.byte
+local s = string.rep('abcdefghij', 10)
+local n = 0
+for i = 1, #s do n = n + byte(s, i) end
+print(n)
+n = 0
+for i = 1, 200 do n = n + byte(s, -1) + byte(s) end
+print(n)
+end
+
+print('-----------------------------------------------------------------------')
+
+print('string.byte out of range')
+do
+local byte = string.byte
+local s = string.rep('hello', 20)
+local n = 0
+for i = 1, 150 do
+  local b = byte(s, i)
+  if b then n = n + b end
+end
+print(n)
+end
+
+print('-----------------------------------------------------------------------')
+
+print('string.sub and string.char')
+do
+local sub, char = string.sub, string.char
+local s = string.rep('the quick brown fox jumps over the lazy dog ', 3)
+local r = ''
+for i = 1, #s do r = r .. sub(s, i, i + 1) end
+print(#r, sub(r, 1, 30))
+local n, neg = 0, -1
+for i = 1, 200 do r = sub(s, neg, i); n = n + #r; neg = neg - 1 end
+print(n, r)
+r = ''
+for i = 1, 200 do r = r .. char(i) .. char(i + 32) end
+print(#r, sub(r, 60, 100))
+end
+
+print('-----------------------------------------------------------------------')
+
+print('other C functions')
+do
+local max, floor, tostring = math.max, math.floor, tostring
+local n = 0
+for i = 1, 300 do n = n + max(i, 100) + floor(i + 0.5) end
+print(n)
+local s = ''
+for i = 1, 300 do s = tostring(i) .. s end
+print(#s)
+end
+
+print('-----------------------------------------------------------------------')
+
+print('C function raising an error')
+do
+local ok, err = pcall(function()
+  local rep = string.rep
+  local n, arg = 0, 'x'
+  for i = 1, 100 do n = n + #rep(arg, i); arg = 'y' end
+  return n
+end)
+print(ok, err)
+ok, err = pcall(function()
+  local utf8char = utf8.char
+  local n, code = 0, 0x7FFFFFFF - 150
+  for i = 1, 200 do n = n + #utf8char(code + i) end
+  return n
+end)
+print(ok, err)
+end
+
+print('-----------------------------------------------------------------------')
+
+print('yield from a trace')
+do
+local co = coroutine.wrap(function()
+  local yield = coroutine.yield
+  local n = 0
+  for i = 1, 200 do
+    n = n + i
+    yield(n)
+  end
+  return n
+end)
+for i = 1, 200 do local n = co() if i > 195 then print(n) end end
+end
+
+print('-----------------------------------------------------------------------')
+
+print('C function calling the recorded function again')
+do
+local function f(f, pc, d)
+  local s = 0
+  local b = d:byte(1) + 0
+  for i = 1, 60 do
+    local x = d:sub(2)
+    local ok, v = pc(f, f, pc, x)
+    s = s + i
+  end
+  return s
+end
+print(pcall(f, f, pcall, 'abc'))
+end
+
+print('-----------------------------------------------------------------------')
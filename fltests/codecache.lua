@@ -0,0 +1,47 @@
+if jit and jit.logger then jit.logger('none') end
+
+-- The budget only holds a few traces, so the least recently executed ones
+-- are evicted and compiled again later
+if jit and jit.limit then jit.limit(60) end
+
+local function makeloop(k)
+  return load([[
+    local n = ...
+    local s = 0
+    for i = 1, n do s = s + i + ]] .. k .. [[ end
+    return s
+  ]])
+end
+
+local loops = {}
+for k = 1, 6 do loops[k] = makeloop(k) end
+
+print('more traces than the budget')
+do
+for round = 1, 3 do
+  for k = 1, 6 do
+    print(round, k, loops[k](1000))
+  end
+end
+end
+
+print('-----------------------------------------------------------------------')
+
+print('hot loop between cold loops')
+do
+for round = 1, 6 do
+  print(round, loops[1](2000), loops[round](round * 100))
+end
+end
+
+print('-----------------------------------------------------------------------')
+
+print('budget restored')
+do
+if jit and jit.limit then jit.limit(16 * 1024) end
+for k = 1, 6 do
+  print(k, loops[k](500))
+end
+end
+
+print('-----------------------------------------------------------------------')
@@ -55,3 +55,54 @@ f(0, 100, 1)
 f(100, 0, -1)
 end
 
+
+print('-----------------------------------------------------------------------')
+
+do
+print('float loops')
+local a = 0
+for i = 1, 100, 0.5 do a = a + i end
+print(a)
+a = 0
+for i = 100.0, 1, -0.25 do a = a + i * 2 end
+print(a)
+a = 0
+for i = 0.1, 60 do a = a + i end
+print(a)
+a = 0
+for i = 1, 200.5 do a = a + i end
+print(a, math.type(a))
+end
+
+print('-----------------------------------------------------------------------')
+
+do
+print('non constant limits and steps')
+local function f(start, limit, step)
+  local a, n = 0, 0
+  for i = start, limit, step do a = a + i; n = n + 1 end
+  print(a, n)
+end
+for _, limit in ipairs({100, 250, 0, -5, 300}) do f(1, limit, 1) end
+f(1, 200, 3)
+f(200, 1, -3)
+f(0.5, 100, 0.75)
+f(100, 0.5, -0.75)
+f(1, 0/0, 1.0)
+f(1.0, 100, 0/0)
+f(1, math.huge, math.huge)
+f(math.huge, 0, -math.huge)
+f(1, 100, 1)
+f(1, 100, -1)
+end
+
+print('-----------------------------------------------------------------------')
+
+do
+print('inner float loops')
+local a = 0
+for i = 1, 100 do
+  for j = 0.5, 30.5, 0.5 do a = a + j end
+end
+print(a)
+end
@@ -0,0 +1,70 @@
+if jit and jit.logger then jit.logger('none') end
+
+print('strings created in a long loop')
+do
+local tostring = tostring
+collectgarbage()
+local base = collectgarbage('count')
+local s
+for i = 1, 200000 do s = tostring(i) .. 'x' end
+print(s, collectgarbage('count') - base < 10000)
+end
+
+print('-----------------------------------------------------------------------')
+
+print('tables created in a long loop')
+do
+collectgarbage()
+local base = collectgarbage('count')
+local t
+for i = 1, 200000 do t = {i, i + 1, {i, 's' .. i}} end
+print(#t, #t[3], collectgarbage('count') - base < 10000)
+end
+
+print('-----------------------------------------------------------------------')
+
+print('finalizers called by the loop')
+do
+local setmetatable = setmetatable
+local n = 0
+local mt = {__gc = function() n = n + 1 end}
+for i = 1, 2000 do setmetatable({}, mt) end
+local x = 0
+for i = 1, 100000 do
+  local t = {i, i}
+  x = x + #t
+end
+collectgarbage()
+print(n, x)
+end
+
+print('-----------------------------------------------------------------------')
+
+print('collectgarbage inside the loop')
+do
+local collectgarbage = collectgarbage
+local t
+for i = 1, 3000 do
+  t = {'a' .. i, 'b' .. i}
+  collectgarbage('step')
+end
+print(t[1], t[2])
+end
+
+print('-----------------------------------------------------------------------')
+
+print('constructors with many stores')
+do
+local items = {}
+for i = 1, 120 do items[i] = "i .. '" .. i .. "'" end
+local code = 'local t\n' ..
+    'for i = 1, 3000 do t = {' .. table.concat(items, ', ') .. '} end\n' ..
+    'return t'
+local t = load(code)()
+collectgarbage()
+local s = 0
+for i = 1, #t do s = s + #t[i] end
+print(#t, t[1], t[120], s)
+end
+
+print('-----------------------------------------------------------------------')
@@ -0,0 +1,142 @@
+if jit and jit.logger then jit.logger('none') end
+
+-- stock Lua 5.3 has no generational mode
+local gen = pcall(collectgarbage, 'generational')
+
+local function count(t)
+  local n = 0
+  for k in pairs(t) do n = n + 1 end
+  return n
+end
+
+print('binary trees')
+do
+local function make(d)
+  if d == 0 then return {} end
+  return {make(d - 1), make(d - 1)}
+end
+local function check(t)
+  if not t[1] then return 1 end
+  return 1 + check(t[1]) + check(t[2])
+end
+local long = make(12)
+local s = 0
+for i = 1, 200 do s = s + check(make(8)) end
+print(s, check(long))
+for i = 1, 20 do long[1] = make(10); collectgarbage('step') end
+print(check(long))
+end
+
+print('-----------------------------------------------------------------------')
+
+print('old objects pointing to young ones')
+do
+local old = {}
+collectgarbage()
+for i = 1, 5000 do
+  old[i] = {v = i, s = 'str' .. i}
+  if i % 500 == 0 then collectgarbage('step') end
+end
+local s = 0
+for i = 1, #old do s = s + old[i].v + #old[i].s end
+print(#old, s)
+local closures = {}
+for i = 1, 1000 do
+  local up = {i}
+  closures[i] = function() return up[1] end
+  if i % 100 == 0 then collectgarbage('step') end
+end
+s = 0
+for i = 1, #closures do s = s + closures[i]() end
+print(s)
+end
+
+print('-----------------------------------------------------------------------')
+
+print('weak tables')
+do
+local wk = setmetatable({}, {__mode = 'k'})
+local wv = setmetatable({}, {__mode = 'v'})
+local wkv = setmetatable({}, {__mode = 'kv'})
+local live = {}
+for i = 1, 1000 do
+  local o = {}
+  wk[o] = i
+  wv[i] = o
+  wkv[o] = o
+  if i % 4 == 0 then live[#live + 1] = o end
+end
+collectgarbage()
+collectgarbage()
+print(count(wk), count(wv), count(wkv))
+live = nil
+collectgarbage()
+collectgarbage()
+print(count(wk), count(wv), count(wkv))
+local eph = setmetatable({}, {__mode = 'k'})
+local k = {}
+eph[k] = {k}
+collectgarbage()
+print(count(eph))
+k = nil
+collectgarbage()
+collectgarbage()
+print(count(eph))
+end
+
+print('-----------------------------------------------------------------------')
+
+print('finalizers')
+do
+local log = {}
+local saved
+for i = 1, 10 do
+  setmetatable({}, {__gc = function(o)
+    log[#log + 1] = i
+    if i == 5 then saved = o end
+  end})
+end
+collectgarbage()
+collectgarbage()
+table.sort(log)
+print(#log, table.concat(log, ' '), saved ~= nil)
+saved = nil
+collectgarbage()
+print(#log)
+end
+
+print('-----------------------------------------------------------------------')
+
+print('coroutines')
+do
+local co = coroutine.wrap(function()
+  local acc = {}
+  for i = 1, 2000 do
+    acc[#acc + 1] = {i}
+    if i % 100 == 0 then coroutine.yield(#acc) end
+  end
+  return #acc
+end)
+local last
+for i = 1, 20 do
+  last = co()
+  collectgarbage('step')
+end
+print(last, co())
+end
+
+print('-----------------------------------------------------------------------')
+
+print('switching modes')
+do
+if gen then print(collectgarbage('incremental')) else print('generational') end
+if gen then print(collectgarbage('incremental')) else print('incremental') end
+if gen then print(collectgarbage('generational')) else print('incremental') end
+local t = {}
+for i = 1, 10000 do t[i % 100 + 1] = {i} end
+collectgarbage()
+print(#t, t[1][1], collectgarbage('isrunning'))
+if gen then collectgarbage('incremental') end
+end
+
+print('-----------------------------------------------------------------------')
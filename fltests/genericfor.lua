@@ -0,0 +1,126 @@
+if jit and jit.logger then jit.logger('none') end
+
+print('ipairs')
+do
+local t = {}
+for i = 1, 1000 do t[i] = i * 3 end
+local n = 0
+for i, v in ipairs(t) do n = n + i + v end
+print(n)
+n = 0
+for i in ipairs(t) do n = n + i end
+print(n)
+local e = 0
+for i, v in ipairs({}) do e = e + 1 end
+print(e)
+end
+
+print('-----------------------------------------------------------------------')
+
+print('ipairs stops at the first nil')
+do
+local t = {}
+for i = 1, 500 do t[i] = i end
+t[301] = nil
+local n, last = 0, 0
+for i, v in ipairs(t) do n = n + v; last = i end
+print(n, last)
+end
+
+print('-----------------------------------------------------------------------')
+
+print('ipairs with changing value types')
+do
+local tostring = tostring
+local t = {}
+for i = 1, 300 do t[i] = i end
+for i = 301, 600 do t[i] = i + 0.5 end
+for i = 601, 700 do t[i] = 'x' end
+local n, s = 0, ''
+for i, v in ipairs(t) do s = v .. '' ; n = n + i end
+print(n, s)
+local f = 0
+for i = 1, 3 do
+  for _, v in ipairs(t) do f = f + #tostring(v) end
+end
+print(f)
+end
+
+print('-----------------------------------------------------------------------')
+
+print('ipairs with metatable')
+do
+local t = setmetatable({}, {__index = function(t, k)
+  if k <= 400 then return k * 2 end
+end})
+for i = 1, 200 do rawset(t, i, i) end
+local n, last = 0, 0
+for i, v in ipairs(t) do n = n + v; last = i end
+print(n, last)
+end
+
+print('-----------------------------------------------------------------------')
+
+print('pairs over the array and the hash parts')
+do
+local tostring = tostring
+local t = {}
+for i = 1, 300 do t[i] = i end
+for i = 1, 300 do t['k' .. i] = i * 2 end
+for i = 1, 100 do t[i + 0.5] = 1 end
+local n, count = 0, 0
+for k, v in pairs(t) do n = n + v; count = count + 1 end
+print(n, count)
+count = 0
+for k in next, t do count = count + 1 end
+print(count)
+local keys = 0
+for k, v in pairs(t) do keys = keys + #tostring(k) end
+print(keys)
+end
+
+print('-----------------------------------------------------------------------')
+
+print('pairs with mixed value types')
+do
+local tostring = tostring
+local t = {}
+for i = 1, 200 do t[i] = i end
+for i = 1, 200 do t['s' .. i] = 's' .. i end
+local n, len = 0, 0
+for k, v in pairs(t) do len = len + #tostring(v); n = n + 1 end
+print(n, len)
+end
+
+print('-----------------------------------------------------------------------')
+
+print('generic for inside numeric for')
+do
+local t = {}
+for i = 1, 100 do t[i] = i end
+local n = 0
+for j = 1, 100 do
+  for i, v in ipairs(t) do n = n + v end
+  for k, v in pairs(t) do n = n + k end
+end
+print(n)
+end
+
+print('-----------------------------------------------------------------------')
+
+print('other iterators')
+do
+local s = string.rep('lorem ipsum dolor sit amet ', 40)
+local n, w = 0, ''
+for word in string.gmatch(s, '%a+') do n = n + #word; w = word end
+print(n, w)
+local function range(max, i)
+  i = i + 1
+  if i <= max then return i end
+end
+n = 0
+for i in range, 300, 0 do n = n + i end
+print(n)
+end
+
+print('-----------------------------------------------------------------------')
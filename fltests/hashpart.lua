@@ -0,0 +1,79 @@
+if jit and jit.logger then jit.logger('none') end
+
+local function count(t)
+  local n = 0
+  for k in pairs(t) do n = n + 1 end
+  return n
+end
+
+print('keys with the same low bits')
+do
+local t = {}
+for i = 1, 2000 do t[i * 65536] = i end
+for i = 1, 2000 do t[i * 0.5 + 0.25] = -i end
+local s = 0
+for i = 1, 2000 do s = s + t[i * 65536] - t[i * 0.5 + 0.25] end
+print(s, count(t), t[65536], t[0.75], t[3 * 65536 + 1], t[1.25])
+end
+
+print('-----------------------------------------------------------------------')
+
+print('removals during traversal')
+do
+local t = {}
+for i = 1, 500 do t['k' .. i] = i; t[i * 1.5] = i end
+local n, s = 0, 0
+for k, v in pairs(t) do
+  n = n + 1
+  s = s + v
+  t[k] = nil
+end
+print(n, s, count(t), next(t))
+for i = 1, 100 do t['k' .. i] = i end
+print(count(t), t.k100, t.k101)
+end
+
+print('-----------------------------------------------------------------------')
+
+print('keys removed and inserted again')
+do
+local t = {}
+local keys = {}
+for i = 1, 300 do keys[i] = {} end
+for r = 1, 10 do
+  for i = 1, 300 do t[keys[i]] = r end
+  for i = 1, 300, 2 do t[keys[i]] = nil end
+  collectgarbage()
+end
+local n, s = 0, 0
+for k, v in pairs(t) do n = n + 1; s = s + v end
+print(n, s, t[keys[1]], t[keys[2]])
+for i = 1, 300 do t[keys[i]] = nil end
+collectgarbage()
+for i = 1, 300, 3 do t[keys[i]] = i end
+n, s = 0, 0
+for k, v in pairs(t) do n = n + 1; s = s + v end
+print(n, s)
+end
+
+print('-----------------------------------------------------------------------')
+
+print('weak keys')
+do
+local t = setmetatable({}, {__mode = 'k'})
+local live = {}
+for i = 1, 1000 do
+  local k = {}
+  t[k] = i
+  if i % 10 == 0 then live[#live + 1] = k end
+end
+collectgarbage()
+local n, s = 0, 0
+for k, v in pairs(t) do n = n + 1; s = s + v end
+print(n, s)
+for i = 1, #live do t[live[i]] = nil end
+collectgarbage()
+print(count(t), next(t))
+end
+
+print('-----------------------------------------------------------------------')
@@ -0,0 +1,54 @@
+if jit and jit.logger then jit.logger('none') end
+
+print('count hook over hot loops')
+do
+local n = 0
+debug.sethook(function() n = n + 1 end, '', 4)
+for i = 1, 1000 do end
+local s = 0
+for i = 1, 1000 do s = s + i end
+debug.sethook()
+print(n, s)
+end
+
+print('-----------------------------------------------------------------------')
+
+print('line hook over hot loops')
+do
+local lines = 0
+local function f(t)
+  local s = 0
+  for i = 1, #t do
+    s = s + t[i]
+  end
+  return s
+end
+local t = {}
+for i = 1, 300 do t[i] = i end
+for r = 1, 5 do f(t) end  -- compile the loop
+debug.sethook(function(ev, line) lines = lines + 1 end, 'l')
+local s = f(t)
+debug.sethook()
+print(lines, s)
+end
+
+print('-----------------------------------------------------------------------')
+
+print('hook set from inside a loop')
+do
+local n = 0
+local function hook() n = n + 1 end
+local s = 0
+for i = 1, 2000 do
+  s = s + i
+  if i == 1500 then debug.sethook(hook, '', 1) end
+end
+debug.sethook()
+print(n > 500, s)
+n = 0
+s = 0
+for i = 1, 2000 do s = s + i end
+print(n, s)
+end
+
+print('-----------------------------------------------------------------------')
@@ -0,0 +1,92 @@
+if jit and jit.logger then jit.logger('none') end
+
+print('globals')
+do
+local function f(n) local s = 0; for i = 1, n do s = s + math.abs(-i) end return s end
+print(f(10), f(100))
+x_icache = 1
+local function g() return x_icache end
+print(g(), g())
+x_icache = nil
+print(g())
+x_icache = 'again'
+print(g(), g())
+for i = 1, 50 do _G['y_icache' .. i] = i end
+print(g(), y_icache50)
+end
+
+print('-----------------------------------------------------------------------')
+
+print('fields of differently shaped tables')
+do
+local function get(t) return t.x end
+local shapes = {
+  {x = 1}, {y = 2, x = 3}, {a = 1, b = 2, c = 3, x = 4}, {10, 20, x = 5},
+  {}, {y = 6}, setmetatable({}, {__index = {x = 7}}),
+  setmetatable({}, {__index = function(t, k) return k .. '!' end}),
+}
+for round = 1, 3 do
+  for i = 1, #shapes do io.write(tostring(get(shapes[i])), ' ') end
+end
+print()
+local function key(t, k) return t[k] end
+local t = {alpha = 1, beta = 2, gamma = 3}
+print(key(t, 'alpha'), key(t, 'beta'), key(t, 'gamma'), key(t, 'delta'))
+print(key(t, 'beta'), key(t, 1), key(t, 'beta'))
+print(key('abc', 'len') == string.len, pcall(key, nil, 'x'))
+end
+
+print('-----------------------------------------------------------------------')
+
+print('removed keys and rehash')
+do
+local function get(t) return t.k end
+local t = {k = 1, a = 2}
+print(get(t), get(t))
+t.k = nil
+print(get(t), get(t))
+t.k = 3
+print(get(t))
+for i = 1, 100 do t['f' .. i] = i end
+print(get(t), get(t), t.f1, t.f100)
+for i = 1, 100 do t['f' .. i] = nil end
+t.k = nil
+collectgarbage()
+for i = 1, 10 do t['g' .. i] = i end
+print(get(t), t.a, t.g10)
+setmetatable(t, {__index = {k = 'meta'}})
+print(get(t), get(t))
+end
+
+print('-----------------------------------------------------------------------')
+
+print('method calls')
+do
+local Point = {}
+Point.__index = Point
+function Point.new(x, y) return setmetatable({x = x, y = y}, Point) end
+function Point:norm1() return math.abs(self.x) + math.abs(self.y) end
+function Point:add(o) return Point.new(self.x + o.x, self.y + o.y) end
+local p = Point.new(0, 0)
+for i = 1, 100 do p = p:add(Point.new(i, -i)) end
+print(p.x, p.y, p:norm1())
+local q = Point.new(1, 2)
+q.norm1 = function() return 'own' end
+print(q:norm1(), p:norm1())
+print(('abc'):upper(), ('x'):rep(3))
+print(pcall(function() local n = 1; return n:foo() end))
+print(pcall(function() return p:missing() end))
+end
+
+print('-----------------------------------------------------------------------')
+
+print('error messages')
+do
+local function f(t) return t.a.b end
+print(f({a = {b = 1}}))
+print(pcall(f, {}))
+print(pcall(f, {a = 1}))
+print(pcall(function() return undefined_icache.x end))
+end
+
+print('-----------------------------------------------------------------------')
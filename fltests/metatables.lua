@@ -0,0 +1,70 @@
+if jit and jit.logger then jit.logger('none') end
+
+print('fields and methods of strings')
+do
+local s = string.rep('abc', 100)
+local n = 0
+for i = 1, #s do n = n + s:byte(i) + s:len() end
+print(n)
+local r = ''
+for i = 1, 100 do r = r .. s:sub(i, i) end
+print(r)
+end
+
+print('-----------------------------------------------------------------------')
+
+print('own fields and __index chains')
+do
+local Base = {kind = 'base', size = 10}
+Base.__index = Base
+local Derived = setmetatable({scale = 3}, Base)
+Derived.__index = Derived
+local obj = setmetatable({x = 1}, Derived)
+local tostring = tostring
+local n, s = 0, ''
+for i = 1, 300 do
+  n = n + obj.x + obj.scale * obj.size
+  s = obj.kind .. tostring(obj.missing)
+end
+print(n, s)
+end
+
+print('-----------------------------------------------------------------------')
+
+print('changes inside the loop')
+do
+local Class = {value = 1}
+Class.__index = Class
+local Other = {__index = {value = 1.5}}
+local obj = setmetatable({}, Class)
+local changes = {
+  function() Class.value = 2 end,
+  function() rawset(obj, 'value', 10) end,
+  function() obj.value = nil; setmetatable(obj, Other) end,
+  function() setmetatable(obj, {__index = function() return 7 end}) end,
+  function() end,
+}
+local n = 0
+for round = 1, #changes do
+  for i = 1, 100 do n = n + obj.value end
+  changes[round]()
+end
+print(n)
+end
+
+print('-----------------------------------------------------------------------')
+
+print('methods with C functions')
+do
+local Class = {max = math.max, tostring = tostring}
+Class.__index = Class
+local obj = setmetatable({}, Class)
+local n, len = 0, 0
+for i = 1, 300 do
+  n = n + obj.max(i, 150)
+  len = len + #obj.tostring(i)
+end
+print(n, len)
+end
+
+print('-----------------------------------------------------------------------')
@@ -0,0 +1,60 @@
+if jit and jit.logger then jit.logger('none') end
+
+print('inner loop with variable limit')
+do
+local s = 0
+for j = 1, 300 do
+  for i = 1, j do s = s + i end
+  s = s + 1
+end
+print(s)
+end
+
+print('-----------------------------------------------------------------------')
+
+print('inner loop with float accumulator')
+do
+local f = 0.5
+for j = 1, 300 do
+  for i = 1, 100 do f = f + 1 end
+end
+print(f)
+end
+
+print('-----------------------------------------------------------------------')
+
+print('inner loop that changes type')
+do
+local a = 0
+for j = 1, 300 do
+  local x = 1
+  if j > 200 then x = 0.5 end
+  for i = 1, 10 do a = a + x end
+end
+print(a)
+end
+
+print('-----------------------------------------------------------------------')
+
+print('three levels')
+do
+local c = 0
+for k = 1, 100 do
+  for j = 1, 100 do
+    for i = 1, 10 do c = c + 1 end
+  end
+end
+print(c)
+end
+
+print('-----------------------------------------------------------------------')
+
+print('empty inner loop')
+do
+local c = 0
+for j = 1, 300 do
+  for i = 1, 0 do c = c + 1 end
+  c = c + j
+end
+print(c)
+end
@@ -0,0 +1,136 @@
+if jit and jit.logger then jit.logger('none') end
+
+local text = ('lorem ipsum dolor sit amet, '):rep(20) ..
+             'key=value; x = 42; [tag] (paren) 100% done\n' ..
+             ('consectetur adipiscing elit '):rep(20)
+
+print('find with literal prefixes')
+do
+print(text:find('key=%w+'), text:find('x = (%d+)'), text:find('100%%'))
+print(text:find('dolor s'), text:find('dolor', 100), text:find('dolor', -40))
+print(text:find('zzz'), text:find('ame+t'), text:find('am?et'), text:find('a-met'))
+print(text:find('%[tag%]'), text:find('%(paren%)'), text:find('done\n'))
+print(text:find('elit $'), text:find('elit$'), text:find('a$b'), ('a$b'):find('a$b'))
+print(('aaab'):find('a+b'), ('xaaab'):find('aa+b'), ('ab'):find('b*a'))
+print(('^x'):find('^x'), ('a^x'):find('a^x'), ('ab'):find('()b'), ('ab'):find('(b)'))
+print((''):find('a'), (''):find('a*'), ('abc'):find('c', 10), ('abc'):find('', 4))
+end
+
+print('-----------------------------------------------------------------------')
+
+print('find with classes')
+do
+print(text:find('%d+'), text:find('[;=]'), text:find('[^%l%s,]'), text:find('%p%s'))
+print(text:find('%u'), text:find('[%]]'), text:find('[]]'), text:find('[^]]'))
+print(text:find('%d*'), text:find('[xy]?=%s'), text:find('%s-x'))
+print(text:find('%bxy'), text:find('%b()'), text:find('%b[]'), ('x(a(b)c)'):find('%b()'))
+print(text:find('%f[%d]%d+'), text:find('%f[%a]%a+'), ('THE (quick) fox'):find('%f[%l]%a+'))
+print(('aXbXc'):find('%q'), ('a.b'):find('%.'), ('a.b'):find('.b'))
+for _, p in ipairs{'%a+', '[%w_]+', '[^%s]+', '%x%x', '[a-f]+', '%c'} do
+  io.write(table.concat({text:find(p, 30)}, ','), ' ')
+end
+print()
+end
+
+print('-----------------------------------------------------------------------')
+
+print('match and gmatch')
+do
+print(text:match('(%w+)=(%w+)'), text:match('x = (%d+)'), text:match('%[(%a+)%]'))
+print(text:match('(s)(i)(t)', 50), text:match('()amet()'), text:match('%d+%%'))
+local n, last = 0
+for w in text:gmatch('dolor') do n = n + 1; last = w end
+print(n, last)
+n = 0
+for a, b in text:gmatch('(%a+)%s+(%a+),') do n = n + 1; last = a .. b end
+print(n, last)
+local t = {}
+for k in ('a1b22c333'):gmatch('%d+') do t[#t + 1] = k end
+print(table.concat(t, '|'))
+t = {}
+for k in ('one two  three'):gmatch('%a*') do t[#t + 1] = '<' .. k .. '>' end
+print(table.concat(t))
+t = {}
+for k in ('^a^b'):gmatch('^%a') do t[#t + 1] = k end
+print(table.concat(t, '|'))
+t = {}
+for p in ('abcabc'):gmatch('()c') do t[#t + 1] = p end
+print(table.concat(t, '|'))
+end
+
+print('-----------------------------------------------------------------------')
+
+print('gsub')
+do
+print((text:gsub('dolor', 'DOLOR')):sub(1, 60), select(2, text:gsub('dolor', '')))
+print(text:gsub('%d+', function(d) return '<' .. d .. '>' end):match('x = (%S+)'))
+print(('hello world'):gsub('o', '0'), ('hello world'):gsub('o', '0', 1))
+print(('hello world'):gsub('l+', {ll = 'LL'}), ('hello'):gsub('x', 'y'))
+print(('abc'):gsub('', '-'), ('abc'):gsub('b*', '-'), ('abc'):gsub('^a', 'A'))
+print(('a.b.c'):gsub('%.', '/'), ('a,b;c'):gsub('[,;]', ' '), ('x'):gsub('x$', 'y'))
+print(('(a)(b)'):gsub('%b()', '[]'), ('THE (quick) fox'):gsub('%f[%a]%a+', '*'))
+print((''):gsub('a', 'b'), ('aaa'):gsub('a', '%0%0'), ('abab'):gsub('(a)(b)', '%2%1'))
+print(('line1\nline2\n'):gsub('\n', '\\n'), ('a\0b\0c'):gsub('\0', '.'))
+end
+
+print('-----------------------------------------------------------------------')
+
+print('malformed patterns')
+do
+print(pcall(string.find, 'abc', '[a'), pcall(string.find, 'abc', 'x%'))
+print(pcall(string.find, 'abc', '%'), pcall(string.find, 'abc', 'a%'))
+print(pcall(string.find, 'xyz', 'a%'), pcall(string.find, 'abc', '%b'))
+print(pcall(string.find, 'abc', '%bx'), pcall(string.find, 'abc', '(x'))
+print(pcall(string.gsub, 'abc', '[a', 'x', 0), pcall(string.gsub, 'abc', 'x)', ''))
+print(pcall(string.match, 'abc', 'a)'), pcall(string.match, 'abc', ')'))
+print(pcall(string.gmatch('abc', '[%')))
+print(pcall(string.find, 'abc', ('('):rep(40) .. 'x'))
+print(pcall(string.find, 'abc', '%1'), pcall(string.find, 'abc', '%f'))
+end
+
+print('-----------------------------------------------------------------------')
+
+print('cached sets')
+do
+local classes = {}
+for i = 1, 200 do classes[i] = '[' .. string.char(97 + i % 26) .. '-z' .. i % 10 .. ']' end
+local s = 0
+for r = 1, 3 do
+  for i = 1, #classes do s = s + (text:find(classes[i]) or 0) end
+end
+print(s, text:find('[' .. ('%d'):rep(20) .. 'q]'), ('q'):find('[' .. ('%d'):rep(20) .. 'q]'))
+print(('abc'):find('[%a]'), ('123'):find('[%a]'), ('123'):find('[%A]'), ('abc'):find('[%A]'))
+end
+
+print('-----------------------------------------------------------------------')
+
+print('locale changes')
+do
+local word = 'x \233t\233 ok'  -- accented letters in Latin-1
+local function probe()
+  local t = {}
+  for w in word:gmatch('%a+') do t[#t + 1] = w end
+  return word:find('%a', 3), word:match('[%w]+', 3), (word:gsub('%l', '.')),
+         table.concat(t, '|')
+end
+print(probe())
+for _, name in ipairs{'pt_BR.ISO-8859-1', 'fr_FR.ISO-8859-1',
+                      'de_DE.ISO-8859-1', 'en_US.ISO-8859-1', 'C.utf8'} do
+  if os.setlocale(name, 'ctype') then print(probe()) break end
+end
+os.setlocale('C', 'ctype')
+print(probe())
+local t = {}
+for w in word:gmatch('%a+') do
+  t[#t + 1] = w
+  os.setlocale(#t % 2 == 1 and 'C.utf8' or 'C', 'ctype')
+end
+os.setlocale('C', 'ctype')
+print(table.concat(t, '|'), (word:gsub('%a+', function(w)
+  os.setlocale('C.utf8', 'ctype')
+  return '<' .. w .. '>'
+end)))
+os.setlocale('C', 'ctype')
+end
+
+print('-----------------------------------------------------------------------')
@@ -0,0 +1,27 @@
+if jit and jit.logger then jit.logger('none') end
+
+print('loop that always fails to record')
+do
+local t = {}
+local s = 0
+for j = 1, 1000 do
+  for i = 1, 100 do t[i] = i end
+  s = s + #t
+end
+print(s)
+end
+
+print('-----------------------------------------------------------------------')
+
+print('loop that exits early')
+do
+local function f(a)
+  local s = 0
+  for i = 1, 100 do s = s + a end
+  return s
+end
+for j = 1, 200 do
+  local r = f(j % 2 == 0 and 1 or 0.5)
+  if j > 195 then print(r) end
+end
+end
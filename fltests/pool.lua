@@ -0,0 +1,78 @@
+if jit and jit.logger then jit.logger('none') end
+
+-- stock Lua (and builds without the pools) have no statistics; every check
+-- then holds trivially
+local allocstats = jit and jit.allocstats or function() return nil end
+
+print('small blocks come from the pools')
+do
+collectgarbage()
+local a = allocstats()
+local t = {}
+for i = 1, 50000 do t[i] = {i, tostring(i)} end
+local b = allocstats()
+print(a == nil or b.pooled - a.pooled > 50000 * 56)
+print(a == nil or b.pages > a.pages, a == nil or b.pagesize == 65536)
+local s = 0
+for i = 1, #t do s = s + t[i][1] + #t[i][2] end
+print(#t, s)
+end
+
+print('-----------------------------------------------------------------------')
+
+print('large blocks use realloc')
+do
+collectgarbage()
+local a = allocstats()
+local big = ('x'):rep(1000000)
+local b = allocstats()
+print(a == nil or b.large - a.large >= 1000000, #big)
+big = nil
+collectgarbage()
+local c = allocstats()
+print(a == nil or c.large < b.large)
+end
+
+print('-----------------------------------------------------------------------')
+
+print('empty pages are released')
+do
+collectgarbage()
+local a = allocstats()
+local t = {}
+for i = 1, 100000 do t[i] = {} end
+local b = allocstats()
+t = nil
+collectgarbage()
+collectgarbage()
+local c = allocstats()
+print(a == nil or c.released > a.released, a == nil or c.pages < b.pages)
+print(a == nil or c.pooled < b.pooled)
+end
+
+print('-----------------------------------------------------------------------')
+
+print('blocks moving between the pools and realloc')
+do
+local ts = {}
+for r = 1, 200 do
+  local t = {}
+  for i = 1, r do t[i] = i end  -- the array part grows out of the pools
+  for i = r, 1, -1 do t[i] = nil end
+  t.x = r
+  collectgarbage('step')
+  for i = 1, 3 do t[i] = i * r end  -- and shrinks back into them
+  ts[r] = t
+end
+local s = 0
+for r = 1, #ts do s = s + ts[r].x + ts[r][1] + ts[r][2] + ts[r][3] end
+local parts = {}
+for i = 1, 300 do parts[i] = ('y'):rep(i) end
+local str = table.concat(parts)
+print(s, #str, str:sub(-5))
+collectgarbage()
+local st = allocstats()
+print(st == nil or st.pooled > 0, st == nil or st.large > 0)
+end
+
+print('-----------------------------------------------------------------------')
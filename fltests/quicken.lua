@@ -0,0 +1,91 @@
+if jit and jit.logger then jit.logger('none') end
+
+print('add with changing types')
+do
+local function add(a, b) return a + b end
+local values = {1, 2.5, '3', 4, 0.5, 7, math.huge, math.mininteger, -1}
+for i = 1, #values do
+  for j = 1, #values do
+    io.write(tostring(add(values[i], values[j])), ' ')
+  end
+end
+print()
+print(add(math.maxinteger, 1), add(0.1, 0.2), add(1, 2), add(1.0, 2))
+local mt = {__add = function(a, b) return 'meta' end}
+local obj = setmetatable({}, mt)
+print(add(1, 2), add(obj, 1), add(1, 2), add(1.5, obj), add(1.5, 1.5))
+print(pcall(add, 1, nil))
+print(pcall(add, 1.5, {}))
+end
+
+print('-----------------------------------------------------------------------')
+
+print('less than with changing types')
+do
+local function lt(a, b) if a < b then return 'y' else return 'n' end end
+local values = {1, 2.5, 3, -0.0, 0, 0 / 0, math.huge, math.mininteger}
+for i = 1, #values do
+  for j = 1, #values do io.write(lt(values[i], values[j])) end
+end
+print()
+print(lt('a', 'b'), lt(1, 2), lt('b', 'a'), lt(2.0, 1.0), lt(1, 1.5))
+local mt = {__lt = function(a, b) return true end}
+local obj = setmetatable({}, mt)
+print(lt(1, 2), lt(obj, obj), lt(2, 1), lt(1.5, 2.5), lt(obj, obj))
+print(pcall(lt, 1, 'x'))
+print(pcall(lt, 1.5, {}))
+end
+
+print('-----------------------------------------------------------------------')
+
+print('array accesses with changing tables')
+do
+local function get(t, k) return t[k] end
+local t = {10, 20, 30}
+local h = setmetatable({1}, {__index = function(t, k) return k * 100 end})
+local s = 0
+for i = 1, 5 do s = s + get(t, i % 3 + 1) end
+print(s, get(t, 1), get(t, 4), get(t, 0), get(t, -1), get(t, 2.0))
+print(get(h, 1), get(h, 2), get(t, 'x'), get(h, 3), get(t, 3))
+t[2] = nil
+print(get(t, 1), get(t, 2), get(t, 3))
+print(get('abc', 'len') == string.len, get(t, 1))
+print(pcall(get, nil, 1))
+print(pcall(get, 1, 1))
+end
+
+print('-----------------------------------------------------------------------')
+
+print('error messages of quickened instructions')
+do
+local function f(t) local a = t[1] + t[2]; return a + t.x end
+print(f({1, 2, x = 3}))
+print(pcall(f, {1, 2}))
+print(pcall(f, {1, 2.5}))
+local function g(t) local v = t[1]; return v < t.y end
+print(g({1, y = 2}))
+print(select(2, pcall(g, {1})))
+local function h(t) return t[1][1] end
+print(h({{5}}))
+print(select(2, pcall(h, {1})))
+end
+
+print('-----------------------------------------------------------------------')
+
+print('yield inside a metamethod')
+do
+local mt = {__lt = function(a, b) coroutine.yield('lt') return true end,
+            __add = function(a, b) coroutine.yield('add') return 42 end}
+local obj = setmetatable({}, mt)
+local function cmp(a, b) if a < b then return 'y' else return 'n' end end
+local function add(a, b) return a + b end
+local co = coroutine.wrap(function()
+  return cmp(obj, obj), add(obj, 1)
+end)
+print(co())
+print(cmp(1, 2), cmp(2.5, 1.5), add(1, 2), add(0.5, 0.25))
+print(co())
+print(co())
+end
+
+print('-----------------------------------------------------------------------')
@@ -0,0 +1,113 @@
+if jit and jit.logger then jit.logger('none') end
+
+-- stock Lua doesn't have string.buffer
+local newbuffer = string.buffer or function()
+  local B = {}
+  B.__index = B
+  function B:put(...)
+    for i = 1, select('#', ...) do
+      local v = select(i, ...)
+      if type(v) ~= 'number' and type(v) ~= 'string' then
+        error('string expected')
+      end
+      self.parts[#self.parts + 1] = tostring(v)
+    end
+    return self
+  end
+  function B:putf(...) return self:put(string.format(...)) end
+  function B:reset() self.parts = {} return self end
+  function B:tostring() return table.concat(self.parts) end
+  B.__tostring = B.tostring
+  B.__len = function(self) return #self:tostring() end
+  return setmetatable({parts = {}}, B)
+end
+
+print('put and tostring')
+do
+local b = newbuffer()
+print(#b, b:tostring() == '', tostring(b) == '')
+b:put('abc'):put(1, 2.5, -3, 1e100, 2^53, -0.0, 1 / 0, math.mininteger)
+print(b:tostring(), #b)
+b:put('\0x\0', '')
+print(#b, b:tostring():byte(-3, -1))
+local s = tostring(b)
+b:put('more')
+print(s == b:tostring(), #s + 4 == #b)
+print((pcall(b.put, b, 'ok', {})), (pcall(b.put, b, nil)), #b)
+end
+
+print('-----------------------------------------------------------------------')
+
+print('putf')
+do
+local b = newbuffer()
+b:putf('%d %s %5.2f|', 42, 'str', math.pi)
+b:putf('%q|', 'a "quoted"\n string')
+b:putf('%x%X%o%%', 255, 255, 8):putf('')
+print(b:tostring())
+b:putf('%s', ('long'):rep(3000))
+print(#b, b:tostring():sub(-8))
+print((pcall(b.putf, b, '%d', 'x')), (pcall(b.putf, b, '%z', 1)), #b)
+end
+
+print('-----------------------------------------------------------------------')
+
+print('reset and reuse')
+do
+local b = newbuffer()
+local total = 0
+for r = 1, 50 do
+  b:reset()
+  for i = 1, 200 do b:put(i, ',') end
+  total = total + #b
+end
+print(total, b:tostring():sub(1, 20), b:tostring():sub(-10))
+b:reset():put('x')
+print(b:tostring(), #b)
+end
+
+print('-----------------------------------------------------------------------')
+
+print('building large strings')
+do
+local b = newbuffer()
+local parts = {}
+for i = 1, 20000 do
+  local item = 'item' .. i .. ';'
+  b:put(item)
+  parts[i] = item
+end
+local s = b:tostring()
+print(#s, s == table.concat(parts), s:sub(1, 12), s:sub(-12))
+local t = {}
+for i = 1, 100 do t[i] = newbuffer() end
+for i = 1, 100 do t[i]:put(i, ':', ('y'):rep(i)) end
+t = nil
+collectgarbage()
+local e = newbuffer()
+e:put(('z'):rep(100000)):put(('z'):rep(100000))
+print(#e, e:tostring() == ('z'):rep(200000))
+end
+
+print('-----------------------------------------------------------------------')
+
+print('contents are collected memory')
+do
+collectgarbage()
+local before = collectgarbage('count')
+local b = newbuffer()
+b:put(('x'):rep(1000000))
+print(collectgarbage('count') - before > 900, #b)
+b = nil
+collectgarbage()
+print(collectgarbage('count') - before < 100)
+local peak = 0
+for i = 1, 200 do
+  local t = newbuffer()
+  t:put(('x'):rep(100000))
+  peak = math.max(peak, collectgarbage('count'))
+end
+print(peak - before < 100000)
+end
+
+print('-----------------------------------------------------------------------')
@@ -0,0 +1,84 @@
+if jit and jit.logger then jit.logger('none') end
+
+print('concat string and number')
+do
+local s = ''
+for i = 1, 200 do s = s .. 'ab' .. i end
+print(#s, s:sub(-20))
+end
+
+print('-----------------------------------------------------------------------')
+
+print('concat in an inner loop')
+do
+local lines = 0
+for i = 1, 100 do
+  local line = ''
+  for j = 1, 60 do line = line .. (j % 10) end
+  lines = lines + #line
+end
+print(lines)
+end
+
+print('-----------------------------------------------------------------------')
+
+print('concat float')
+do
+local s
+for i = 1, 100 do s = i / 4 .. '' end
+print(s)
+end
+
+print('-----------------------------------------------------------------------')
+
+print('length of strings')
+do
+local short, long = 'abc', string.rep('x', 100)
+local n = 0
+for i = 1, 100 do n = n + #short + #long end
+print(n)
+end
+
+print('-----------------------------------------------------------------------')
+
+print('length of tables')
+do
+local t = {}
+for i = 1, 30 do t[i] = i end
+local n = 0
+for i = 1, 100 do n = n + #t end
+print(n)
+local mt = setmetatable({}, {__len = function() return 7 end})
+local tables = {t, mt}
+for j = 1, 2 do
+  local u = tables[j]
+  n = 0
+  for i = 1, 100 do n = n + #u end
+  print(n)
+end
+end
+
+print('-----------------------------------------------------------------------')
+
+print('interning while the string table grows')
+do
+local keep = {}
+for i = 1, 50000 do keep[i] = 'intern' .. i end
+local n = 0
+for i = 1, 50000, 7 do
+  if keep[i] == 'intern' .. i then n = n + 1 end
+end
+local t = {}
+for i = 0, 3000 do
+  local s = {}
+  for p = 1, 40 do s[p] = p % 2 == 1 and string.char(97 + (i >> (p // 2)) % 2) or 'a' end
+  t[table.concat(s)] = i
+end
+local m = 0
+for k, v in pairs(t) do m = m + 1 end
+keep = nil
+collectgarbage()
+print(n, m, 'intern' .. 49999 == 'intern49999')
+end
+
+print('-----------------------------------------------------------------------')
@@ -0,0 +1,98 @@
+if jit and jit.logger then jit.logger('none') end
+
+-- stock Lua doesn't have table.new and table.clear
+local tnew = table.new or function(narr, nrec) return {} end
+local tclear = table.clear or function(t)
+  for k in pairs(t) do rawset(t, k, nil) end
+end
+
+local function count(t)
+  local n = 0
+  for k in pairs(t) do n = n + 1 end
+  return n
+end
+
+print('presized tables')
+do
+local t = tnew(100, 10)
+print(#t, count(t), next(t))
+for i = 1, 100 do t[i] = i end
+for i = 1, 10 do t['k' .. i] = i end
+print(#t, count(t), t[100], t.k10)
+for i = 101, 300 do t[i] = i end
+print(#t, count(t))
+local e = tnew()
+e.x = 1
+print(count(e), e.x, #tnew(0, 0))
+end
+
+print('-----------------------------------------------------------------------')
+
+print('clear keeps working tables')
+do
+local t = {}
+for i = 1, 100 do t[i] = i * 2 end
+for i = 1, 50 do t['s' .. i] = i end
+t[1.5] = true
+tclear(t)
+print(#t, count(t), t[1], t.s1, t[1.5], next(t))
+for i = 1, 100 do t[i] = i end
+for i = 1, 50 do t['s' .. i] = -i end
+print(#t, count(t), t[100], t.s50)
+tclear(t)
+t.x = 'x'
+print(count(t), t.x, #t)
+end
+
+print('-----------------------------------------------------------------------')
+
+print('clear ignores metamethods')
+do
+local log = {}
+local t = setmetatable({a = 1, 2}, {__newindex = function(t, k, v)
+  log[#log + 1] = k
+  rawset(t, k, v)
+end})
+tclear(t)
+print(#log, t.a, t[1], getmetatable(t) ~= nil)
+t.b = 1
+print(#log, log[1], t.b)
+end
+
+print('-----------------------------------------------------------------------')
+
+print('reused tables in a loop')
+do
+local t = tnew(4, 4)
+local s = 0
+for i = 1, 10000 do
+  tclear(t)
+  t[1], t[2], t[3] = i, i + 1, i + 2
+  t.x, t.y = i, 2 * i
+  s = s + t[1] + t[3] + t.y
+end
+print(s, count(t))
+local rows = {}
+for i = 1, 100 do
+  local r = tnew(0, 2)
+  r.id, r.name = i, 'n' .. i
+  rows[i] = r
+end
+print(#rows, rows[100].name, count(rows[1]))
+end
+
+print('-----------------------------------------------------------------------')
+
+print('weak tables and collection')
+do
+local t = setmetatable({}, {__mode = 'k'})
+for i = 1, 100 do t[{}] = i end
+collectgarbage()
+tclear(t)
+collectgarbage()
+local key = {}
+t[key] = 1
+print(count(t), t[key])
+end
+
+print('-----------------------------------------------------------------------')
@@ -0,0 +1,56 @@
+if jit and jit.logger then jit.logger('none') end
+
+print('empty tables')
+do
+local t
+for i = 1, 500 do t = {} end
+print(type(t), #t, next(t))
+end
+
+print('-----------------------------------------------------------------------')
+
+print('array constructors')
+do
+local t
+local s = 'x'
+for i = 1, 500 do t = {i, i * 2, s, 1.5} end
+print(#t, t[1], t[2], t[3], t[4])
+local list = nil
+for i = 1, 1000 do list = {list, i} end
+local n, count = 0, 0
+while list do n = n + list[2]; count = count + 1; list = list[1] end
+print(n, count)
+end
+
+print('-----------------------------------------------------------------------')
+
+print('large constructors')
+do
+local t
+for i = 1, 200 do
+  t = {i, i, i, i, i, i, i, i, i, i, i, i, i, i, i, i, i, i, i, i,
+       i, i, i, i, i, i, i, i, i, i, i, i, i, i, i, i, i, i, i, i,
+       i, i, i, i, i, i, i, i, i, i, i, i, i, i, i, i, i, i, i, i}
+end
+local n = 0
+for _, v in ipairs(t) do n = n + v end
+print(#t, n)
+end
+
+print('-----------------------------------------------------------------------')
+
+print('nested tables under GC pressure')
+do
+local keep = {}
+local t
+for j = 1, 20 do
+  for i = 1, 2000 do t = {{i}, {i + 1, 'a' .. i}, {}} end
+  keep[j] = t
+  collectgarbage('step')
+end
+local n = 0
+for j = 1, 20 do n = n + keep[j][1][1] + keep[j][2][1] + #keep[j][2][2] end
+print(n, #keep)
+end
+
+print('-----------------------------------------------------------------------')
@@ -0,0 +1,111 @@
+if jit and jit.logger then jit.logger('none') end
+
+print('select count')
+do
+local function count(...)
+  local select = select
+  local n = 0
+  for i = 1, 1000 do n = n + select('#', ...) end
+  return n
+end
+print(count())
+print(count(1, 2, 3))
+print(count(nil, nil))
+for i = 1, 5 do print(count(1, nil, 'x', {})) end
+end
+
+print('-----------------------------------------------------------------------')
+
+print('copy the varargs')
+do
+local function sum(...)
+  local n = 0
+  for i = 1, 1000 do
+    local a, b, c = ...
+    n = n + a + b * c
+  end
+  return n
+end
+print(sum(1, 2, 3))
+print(sum(0.5, 2, 4, 5))
+print(pcall(sum, 1, 2))
+local function last(...)
+  local s
+  for i = 1, 500 do
+    local a, b, c = ...
+    s = c
+  end
+  return s
+end
+print(last(1, 2, 3), last(1, 2), last(), last(1, 2, 'x'))
+for i = 1, 5 do print(last(1, 2, i), last(1, 2)) end
+end
+
+print('-----------------------------------------------------------------------')
+
+print('select index')
+do
+local function pick(i, ...)
+  local select = select
+  local n = 0
+  for j = 1, 1000 do
+    local v = select(i, ...)
+    n = n + v
+  end
+  return n
+end
+print(pick(1, 10, 20, 30))
+print(pick(3, 10, 20, 30))
+print(pick(-1, 10, 20, 30))
+print(pick(-3, 10, 20, 30.5))
+print(pcall(pick, 4, 10, 20, 30))
+print(pcall(pick, -4, 10, 20, 30))
+print(pcall(pick, 0, 10, 20, 30))
+local function pair(i, ...)
+  local select = select
+  local a, b
+  for j = 1, 500 do a, b = select(i, ...) end
+  return a, b
+end
+print(pair(1, 'a', 'b', 'c'))
+print(pair(3, 'a', 'b', 'c'))
+print(pair(5, 'a', 'b', 'c'))
+print(pair(-1, 'a', 'b', 'c'))
+print(pair(1, 'a', nil))
+for i = 1, 5 do print(pair(i, 'a', 'b', 'c')) end
+end
+
+print('-----------------------------------------------------------------------')
+
+print('select index changes inside the loop')
+do
+local function walk(...)
+  local select = select
+  local n = 0
+  for j = 1, 100 do
+    for i = 1, select('#', ...) do n = n + select(i, ...) end
+  end
+  return n
+end
+print(walk(1, 2, 3, 4, 5))
+print(walk())
+print(walk(1.5, 2.5))
+end
+
+print('-----------------------------------------------------------------------')
+
+print('C functions with varargs')
+do
+local function limits(...)
+  local max, min = math.max, math.min
+  local a, b = 0, 0
+  for i = 1, 1000 do a = a + max(...); b = b + min(i, ...) end
+  return a, b
+end
+print(limits(3, 9, 4))
+print(limits(1.5, 2))
+for i = 1, 5 do print(limits(i, 2 * i)) end
+print(pcall(limits))
+end
+
+print('-----------------------------------------------------------------------')
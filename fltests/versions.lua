@@ -0,0 +1,51 @@
+if jit and jit.logger then jit.logger('none') end
+
+print('polymorphic loop')
+do
+local function f(a, b)
+  local s = a
+  for i = 1, 100 do s = s + b end
+  return s
+end
+local args = { {0, 1}, {0.0, 0.5}, {0.5, 1}, {'1', 2} }
+for j = 1, 400 do
+  local arg = args[j % #args + 1]
+  local ok, r = pcall(f, arg[1], arg[2])
+  if j > 392 then print(ok, r) end
+end
+end
+
+print('-----------------------------------------------------------------------')
+
+print('more types than versions')
+do
+local function g(a, b)
+  local s = a
+  for i = 1, 50 do s = b end
+  return s
+end
+local args = { 1, 1.5, 'a', true, false, 10, 0.25 }
+for j = 1, 700 do
+  local r = g(nil, args[j % #args + 1])
+  if j > 693 then print(r) end
+end
+end
+
+print('types that keep changing')
+do
+local function g(a, b)
+  local s, n = a, 0
+  for i = 1, 50 do s = b; n = n + 1 end
+  return s, n
+end
+local args = { 1, 1.5, 'a', true, false, 10, 0.25, 'b', 2 }
+local count = 0
+for j = 1, 5000 do
+  local r, n = g(nil, args[j % #args + 1])
+  count = count + n
+  if j > 4995 then print(r, n) end
+end
+print(count, g(0, 'last'))
+end
+
+print('-----------------------------------------------------------------------')
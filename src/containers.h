@@ -179,8 +179,8 @@ TSCC_INLINE void pref##insert(Vector *v, size_t pos, T value) {                \
 /* Erase the element at the required position. */                              \
 TSCC_INLINE void pref##erase(Vector *v, size_t pos) {                          \
   size_t i;                                                                    \
-  tscc_assert(pos <= v->size, "out of bounds");                                \
-  for (i = pos; i < v->size; ++i)                                              \
+  tscc_assert(pos < v->size, "out of bounds");                                 \
+  for (i = pos; i + 1 < v->size; ++i)                                          \
       v->buffer[i] = v->buffer[i + 1];                                         \
   v->size--;                                                                   \
 }                                                                              \
@@ -49,18 +49,31 @@ enum AsmReturnCode {
 /* Opaque data that should be saved in the Lua proto. */
 typedef struct AsmInstrData AsmInstrData;
 
-/* Obtain the function given the instruction. */
-AsmFunction flasm_getfunction(struct Proto *p, Instruction *i);
+/* Execute the compiled functions of the instruction. Each function is a
+ * version of the trace specialized for the types at the loop entry and they
+ * are tried in order. Return FL_EARLY_EXIT if none of them accepted the
+ * types. */
+int flasm_execute(struct lua_State *L, struct Proto *p, Instruction *i,
+                  struct lua_TValue *base);
 
-/* Compile a function and add it to the proto. */
-void flasm_compile(struct lua_State *L, struct Proto *p, Instruction *i,
+/* Obtain the number of compiled functions in the instruction. */
+int flasm_nversions(struct Proto *p, Instruction *i);
+
+/* Compile a function and add it to the proto. If the instruction was already
+ * compiled, the function is added as a new version. Return 0 if the
+ * compilation succeeded. */
+int flasm_compile(struct lua_State *L, struct Proto *p, Instruction *i,
                    struct IRFunction *F);
 
-/* Delete a function and change the opcode to the default one. */
+/* Delete all functions and change the opcode to the default one. */
 void flasm_destroy(struct lua_State *L, struct Proto *p, Instruction *i);
 
 /* Destroy all asm functions in the proto. */
 void flasm_closeproto(struct lua_State *L, struct Proto *p);
 
+/* Change the memory budget of the compiled traces. The least recently
+ * executed traces are evicted until the budget is respected. */
+void flasm_setlimit(struct lua_State *L, size_t limit);
+
 #endif
 
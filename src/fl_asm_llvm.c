@@ -22,7 +22,14 @@
  * IN THE SOFTWARE.
  */
 
+/* mmap's MAP_ANONYMOUS isn't part of C99/POSIX */
+#define _DEFAULT_SOURCE
+
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wpedantic"
@@ -45,6 +52,9 @@
 /* Optimization level set in LLVM. */
 #define ASM_OPT_LEVEL 2
 
+/* Rough estimate of the memory used internally by an execution engine. */
+#define ASM_ENGINESIZE (16 * 1024)
+
 /* Access the asmdata inside the proto. */
 #define asmdata(p, i) (fli_getext(p, i)->u.asmdata)
 
@@ -54,12 +64,32 @@ enum AsmRetCode {
   ASM_ERROR
 };
 
+/* Memory region that holds a section of the machine code. */
+typedef struct AsmSection {
+  void *addr;                       /* mapped pages */
+  size_t size;                      /* size of the mapping */
+  int prot;                         /* protection set after finalization */
+  struct AsmSection *next;
+} AsmSection;
+
 /* Data saved in Lua proto. */
 struct AsmInstrData {
   AsmFunction func;                 /* compiled function */
   LLVMExecutionEngineRef ee;        /* LLVM execution engine */
+  AsmSection *sections;             /* memory with the machine code */
+  size_t codesize;                  /* bytes mapped for the machine code */
+  size_t lastexec;                  /* clock of the last execution */
+  struct Proto *p;                  /* proto that owns the trace */
+  Instruction *i;                   /* instruction that owns the trace */
+  struct AsmInstrData *next;        /* next version of the trace */
+  struct AsmInstrData *prevtrace;   /* previous trace in the global list */
+  struct AsmInstrData *nexttrace;   /* next trace in the global list */
 };
 
+/* Memory charged to the budget for each trace. */
+#define tracesize(data) \
+    (sizeof(AsmInstrData) + (data)->codesize + ASM_ENGINESIZE)
+
 /* State during the compilation. */
 typedef struct AsmState {
   lua_State *L;                     /* Lua state */
@@ -104,6 +134,11 @@ static LLVMOpcode convertbinop(enum IRBinOp op, enum IRType t) {
     case IR_SUB: return t == IR_FLOAT ? LLVMFSub : LLVMSub;
     case IR_MUL: return t == IR_FLOAT ? LLVMFMul : LLVMMul;
     case IR_DIV: return t == IR_FLOAT ? LLVMFDiv : LLVMSDiv;
+    case IR_BAND: return LLVMAnd;
+    case IR_BOR: return LLVMOr;
+    case IR_BXOR: return LLVMXor;
+    case IR_SHL: return LLVMShl;
+    case IR_SHR: return LLVMLShr;
   }
   return 0;
 }
@@ -237,6 +272,10 @@ static void compilevalue(AsmState *A, IRValue v) {
         castfunc = LLVMBuildSIToFP;
       else if (fromtype == IR_FLOAT && ir_isintt(desttype))
         castfunc = LLVMBuildFPToSI;
+      else if (fromtype == IR_PTR && ir_isintt(desttype))
+        castfunc = LLVMBuildPtrToInt;
+      else if (ir_isintt(fromtype) && desttype == IR_PTR)
+        castfunc = LLVMBuildIntToPtr;
       else
         fll_error("invalid cast");
       llvmval = castfunc(A->builder, val, llvmtype, "");
@@ -278,6 +317,23 @@ static void compilevalue(AsmState *A, IRValue v) {
       llvmval = LLVMBuildPhi(A->builder, type, "");
       break;
     }
+    case IR_CALL: {
+      int j, n = i->args.call.nargs;
+      LLVMTypeRef argtypes[IR_MAXARGS];
+      LLVMValueRef args[IR_MAXARGS];
+      LLVMTypeRef functype;
+      LLVMValueRef addr, fptr;
+      for (j = 0; j < n; ++j) {
+        IRValue arg = i->args.call.args[j];
+        argtypes[j] = converttype(ir_instr(arg)->type);
+        args[j] = getllvmvalue(A, arg);
+      }
+      functype = LLVMFunctionType(converttype(i->type), argtypes, n, 0);
+      addr = LLVMConstInt(llvmint(), (size_t)i->args.call.func, 0);
+      fptr = LLVMBuildIntToPtr(A->builder, addr, llvmptrof(functype), "");
+      llvmval = LLVMBuildCall(A->builder, fptr, args, n, "");
+      break;
+    }
   }
   A->values[i->id] = llvmval;
 }
@@ -332,16 +388,84 @@ static int verifymodule(AsmState *A) {
   return ASM_OK;
 }
 
+/* Map a memory region for a section of the machine code. The memory
+ * manager callbacks run inside LLVM, so they can't use the Lua allocator
+ * (it may longjmp); the mapped size is accounted in 'codesize' instead. */
+static uint8_t *allocsection(AsmInstrData *data, uintptr_t size,
+                             unsigned alignment, int prot) {
+  size_t pagesize = (size_t)sysconf(_SC_PAGESIZE);
+  size_t len = ((size + pagesize - 1) / pagesize) * pagesize;
+  AsmSection *section;
+  void *addr;
+  if (alignment > pagesize) return NULL;
+  if (len == 0) len = pagesize;
+  section = malloc(sizeof(AsmSection));
+  if (section == NULL) return NULL;
+  addr = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+              -1, 0);
+  if (addr == MAP_FAILED) {
+    free(section);
+    return NULL;
+  }
+  section->addr = addr;
+  section->size = len;
+  section->prot = prot;
+  section->next = data->sections;
+  data->sections = section;
+  data->codesize += len;
+  return addr;
+}
+
+/* LLVM memory manager callbacks. */
+static uint8_t *allocatecode(void *opaque, uintptr_t size, unsigned alignment,
+                             unsigned id, const char *name) {
+  (void)id; (void)name;
+  return allocsection(opaque, size, alignment, PROT_READ | PROT_EXEC);
+}
+
+static uint8_t *allocatedata(void *opaque, uintptr_t size, unsigned alignment,
+                             unsigned id, const char *name,
+                             LLVMBool readonly) {
+  (void)id; (void)name;
+  return allocsection(opaque, size, alignment,
+                      readonly ? PROT_READ : PROT_READ | PROT_WRITE);
+}
+
+static LLVMBool finalizememory(void *opaque, char **error) {
+  AsmInstrData *data = opaque;
+  AsmSection *section;
+  (void)error;
+  for (section = data->sections; section != NULL; section = section->next)
+    if (mprotect(section->addr, section->size, section->prot))
+      return 1;
+  return 0;
+}
+
+static void destroymemory(void *opaque) {
+  AsmInstrData *data = opaque;
+  while (data->sections != NULL) {
+    AsmSection *next = data->sections->next;
+    munmap(data->sections->addr, data->sections->size);
+    free(data->sections);
+    data->sections = next;
+  }
+}
+
 /* Save the function in the AsmInstrData. */
 static int savefunction(AsmState *A, AsmInstrData *data) {
+  struct LLVMMCJITCompilerOptions options;
   LLVMModuleRef outmodule;
   char *error = NULL;
   LLVMInitializeNativeTarget();
   LLVMInitializeNativeAsmPrinter();
   LLVMInitializeNativeAsmParser();
   LLVMLinkInMCJIT();
-  if (LLVMCreateJITCompilerForModule(&data->ee, A->module, ASM_OPT_LEVEL,
-                                     &error)) {
+  LLVMInitializeMCJITCompilerOptions(&options, sizeof(options));
+  options.OptLevel = ASM_OPT_LEVEL;
+  options.MCJMM = LLVMCreateSimpleMCJITMemoryManager(data, allocatecode,
+      allocatedata, finalizememory, destroymemory);
+  if (LLVMCreateMCJITCompilerForModule(&data->ee, A->module, &options,
+                                       sizeof(options), &error)) {
     fprintf(stderr, "LLVMCreateJITCompilerForModule error: %s\n", error);
     return ASM_ERROR;
   }
@@ -375,31 +499,143 @@ static int compile(struct lua_State *L, IRFunction *F,
  * Target independent section
  */
 
-AsmFunction flasm_getfunction(struct Proto *p, Instruction *i) {
-  return asmdata(p, i)->func;
+/* Release a single version of the trace. */
+static void destroydata(struct lua_State *L, AsmInstrData *data) {
+  if (data->ee)
+    LLVMDisposeExecutionEngine(data->ee);
+  luaM_free(L, data);
+}
+
+/* Insert the trace in the global list and charge its memory. The memory
+ * outside the Lua allocator goes to the GC debt, so it is reported by
+ * collectgarbage('count'). */
+static void linktrace(struct lua_State *L, AsmInstrData *data) {
+  struct FLGlobalState *g = &G(L)->fl;
+  data->prevtrace = NULL;
+  data->nexttrace = g->traces;
+  if (g->traces != NULL)
+    g->traces->prevtrace = data;
+  g->traces = data;
+  g->jitmem += tracesize(data);
+  G(L)->GCdebt += data->codesize + ASM_ENGINESIZE;
 }
 
-void flasm_compile(struct lua_State *L, struct Proto *p, Instruction *i,
-                   struct IRFunction *F) {
-  fli_tojit(p, i);
-  asmdata(p, i) = luaM_new(L, AsmInstrData);
-  asmdata(p, i)->ee = NULL;
-  asmdata(p, i)->func = NULL;
+/* Remove the trace from the global list and release its memory. */
+static void unlinktrace(struct lua_State *L, AsmInstrData *data) {
+  struct FLGlobalState *g = &G(L)->fl;
+  if (data->prevtrace != NULL)
+    data->prevtrace->nexttrace = data->nexttrace;
+  else
+    g->traces = data->nexttrace;
+  if (data->nexttrace != NULL)
+    data->nexttrace->prevtrace = data->prevtrace;
+  g->jitmem -= tracesize(data);
+  G(L)->GCdebt -= data->codesize + ASM_ENGINESIZE;
+  destroydata(L, data);
+}
+
+/* Remove a single version from its instruction. The instruction goes back
+ * to the default opcode if it was the last one. */
+static void evicttrace(struct lua_State *L, AsmInstrData *data) {
+  struct Proto *p = data->p;
+  Instruction *i = data->i;
+  AsmInstrData **prev = &asmdata(p, i);
+  while (*prev != data)
+    prev = &(*prev)->next;
+  *prev = data->next;
+  fllogln("flasm: evicting trace (%zu bytes)", tracesize(data));
+  unlinktrace(L, data);
+  if (asmdata(p, i) == NULL)
+    fli_reset(p, i);
+}
+
+/* Evict the least recently executed traces until 'size' bytes fit in the
+ * budget. Traces can't be evicted while one of them is running. Return 0 if
+ * it succeeded. */
+static int makeroom(struct lua_State *L, size_t size) {
+  struct FLGlobalState *g = &G(L)->fl;
+  while (g->jitmem + size > g->jitlimit) {
+    AsmInstrData *data, *coldest = g->traces;
+    if (coldest == NULL || g->running > 0)
+      return 1;
+    for (data = coldest->nexttrace; data != NULL; data = data->nexttrace)
+      if (data->lastexec < coldest->lastexec)
+        coldest = data;
+    evicttrace(L, coldest);
+  }
+  return 0;
+}
+
+int flasm_execute(struct lua_State *L, struct Proto *p, Instruction *i,
+                  struct lua_TValue *base) {
+  struct FLGlobalState *g = &G(L)->fl;
+  AsmInstrData *data;
+  int status = FL_EARLY_EXIT;
+  g->running++;
+  for (data = asmdata(p, i); data != NULL; data = data->next) {
+    status = data->func(L, base);
+    if (status != FL_EARLY_EXIT) {
+      data->lastexec = ++g->clock;
+      break;
+    }
+  }
+  g->running--;
+  return status;
+}
+
+int flasm_nversions(struct Proto *p, Instruction *i) {
+  AsmInstrData *data;
+  int n = 0;
+  for (data = asmdata(p, i); data != NULL; data = data->next)
+    n++;
+  return n;
+}
+
+int flasm_compile(struct lua_State *L, struct Proto *p, Instruction *i,
+                  struct IRFunction *F) {
+  AsmInstrData *data = luaM_new(L, AsmInstrData);
+  data->ee = NULL;
+  data->func = NULL;
+  data->sections = NULL;
+  data->codesize = 0;
+  data->lastexec = ++G(L)->fl.clock;
+  data->p = p;
+  data->i = i;
+  data->next = NULL;
   fllogln("flasm_compile: starting compilation");
-  if (compile(L, F, asmdata(p, i)) == ASM_ERROR) {
-    flasm_destroy(L, p, i);
+  if (compile(L, F, data) == ASM_ERROR) {
+    destroydata(L, data);
     fllogln("flasm_compile: compilation failed");
+    return 1;
+  }
+  if (makeroom(L, tracesize(data))) {
+    destroydata(L, data);
+    fllogln("flasm_compile: trace doesn't fit in the memory budget");
+    return 1;
+  }
+  linktrace(L, data);
+  if (!fli_isexec(i)) {
+    fli_tojit(p, i);
+    asmdata(p, i) = data;
   }
   else {
-    fllogln("flasm_compile: compilation succeed");
+    /* append the new version */
+    AsmInstrData *last = asmdata(p, i);
+    while (last->next != NULL)
+      last = last->next;
+    last->next = data;
   }
+  fllogln("flasm_compile: compilation succeed (%zu bytes)", tracesize(data));
+  return 0;
 }
 
 void flasm_destroy(struct lua_State *L, struct Proto *p, Instruction *i) {
   AsmInstrData *data = asmdata(p, i);
-  if (data->ee)
-    LLVMDisposeExecutionEngine(data->ee);
-  luaM_free(L, data);
+  while (data != NULL) {
+    AsmInstrData *next = data->next;
+    unlinktrace(L, data);
+    data = next;
+  }
   asmdata(p, i) = NULL;
   fli_reset(p, i);
 }
@@ -408,3 +644,8 @@ void flasm_closeproto(struct lua_State *L, struct Proto *p) {
   fli_foreach(p, i, { if (fli_isexec(i)) flasm_destroy(L, p, i); });
 }
 
+void flasm_setlimit(struct lua_State *L, size_t limit) {
+  G(L)->fl.jitlimit = limit;
+  makeroom(L, 0);
+}
+
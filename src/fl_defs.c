@@ -22,6 +22,8 @@
  * IN THE SOFTWARE.
  */
 
+#include <string.h>
+
 #include "lprefix.h"
 #include "lmem.h"
 #include "lobject.h"
@@ -31,8 +33,17 @@
 #include "fl_defs.h"
 #include "fl_instr.h"
 
+void fl_initglobal(struct FLGlobalState *g) {
+  g->traces = NULL;
+  g->jitmem = 0;
+  g->jitlimit = FL_JIT_MAXMEM;
+  g->clock = 0;
+  g->running = 0;
+}
+
 void fl_initstate(struct lua_State *L) {
   L->fl.trace = NULL;
+  L->fl.seed = cast(unsigned int, cast(size_t, L)) | 1;
 }
 
 void fl_closestate(struct lua_State *L) {
@@ -41,17 +52,22 @@ void fl_closestate(struct lua_State *L) {
 
 void fl_initproto(struct Proto *p) {
   p->fl.initialized = 0;
+  p->fl.icache = NULL;
 }
 
 void fl_closeproto(struct lua_State *L, struct Proto *p) {
   if (!p->fl.initialized) return;
   flasm_closeproto(L, p);
   fliv_destroy(&p->fl.instr);
+  if (p->fl.icache != NULL)  /* NULL if its allocation raised an error */
+    luaM_freearray(L, p->fl.icache, p->sizecode);
 }
 
 void fl_loadproto(struct lua_State *L, struct Proto *p) {
   p->fl.initialized = 1;
   fliv_create(&p->fl.instr, L);
+  p->fl.icache = luaM_newvector(L, p->sizecode, unsigned int);
+  memset(p->fl.icache, 0, p->sizecode * sizeof(unsigned int));
   fli_foreach(p, i, fli_toprof(p, i));
 }
 
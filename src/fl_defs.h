@@ -42,17 +42,66 @@ struct TraceRecording;
 #define FL_JIT_THRESHOLD 50
 #endif
 
+/* Upper bound of the threshold after the loop is penalized. */
+#ifndef FL_JIT_MAXTHRESHOLD
+#define FL_JIT_MAXTHRESHOLD 60000
+#endif
+
+/* Number of random bits added to the threshold in each penalty. */
+#ifndef FL_JIT_PENALTYBITS
+#define FL_JIT_PENALTYBITS 4
+#endif
+
+/* Number of failed recordings/compilations before blacklisting the loop. */
+#ifndef FL_JIT_MAXFAILS
+#define FL_JIT_MAXFAILS 6
+#endif
+
+/* Maximum number of type specialized traces for the same loop. */
+#ifndef FL_JIT_MAXVERSIONS
+#define FL_JIT_MAXVERSIONS 4
+#endif
+
+/* Maximum number of instructions in a trace. */
+#ifndef FL_JIT_MAXTRACELEN
+#define FL_JIT_MAXTRACELEN 500
+#endif
+
+/* Maximum length of the __index chain followed by the traces. */
+#ifndef FL_JIT_MAXINDEXCHAIN
+#define FL_JIT_MAXINDEXCHAIN 8
+#endif
+
+/* Default memory budget of the compiled traces, in bytes. */
+#ifndef FL_JIT_MAXMEM
+#define FL_JIT_MAXMEM (16 * 1024 * 1024)
+#endif
+
 /* Global data that should be stored in lua_State. */
 struct FLState {
   struct TraceRecording *trace;     /* trace beeing recorded */
+  unsigned int seed;                /* pseudo-random state for penalties */
+};
+
+/* Data shared by all threads, stored in global_State. */
+struct FLGlobalState {
+  struct AsmInstrData *traces;      /* list of all compiled traces */
+  size_t jitmem;                    /* memory used by the compiled traces */
+  size_t jitlimit;                  /* budget of 'jitmem' */
+  size_t clock;                     /* incremented at each trace execution */
+  int running;                      /* number of traces in the C stack */
 };
 
 /* Data that should be stored in lua Proto. */
 struct FLProto {
   unsigned int initialized : 1;
   FLInstrExtVector instr;
+  unsigned int *icache;             /* inline cache hints (see fl_vm.h) */
 };
 
+/* Init FastLua global state. */
+void fl_initglobal(struct FLGlobalState *g);
+
 /* Init/destroy FastLua state. */
 void fl_initstate(struct lua_State *L);
 void fl_closestate(struct lua_State *L);
@@ -27,6 +27,7 @@
 #include "lobject.h"
 #include "lopcodes.h"
 
+#include "fl_defs.h"
 #include "fl_instr.h"
 #include "fl_logger.h"
 
@@ -37,6 +38,22 @@ struct FLInstrExt *fli_getext(struct Proto *p, Instruction *i) {
   return fliv_getref(flivec(p), fli_getextindex(i));
 }
 
+Instruction fli_getoriginal(struct Proto *p, Instruction *i) {
+  Instruction original;
+  if (fli_isfl(i))
+    return fli_getext(p, i)->original;
+  original = *i;
+  switch (GET_OPCODE(original)) {
+    case OP_ADDII:
+    case OP_ADDFF:      SET_OPCODE(original, OP_ADD); break;
+    case OP_LTII:
+    case OP_LTFF:       SET_OPCODE(original, OP_LT); break;
+    case OP_GETARRAY:   SET_OPCODE(original, OP_GETTABLE); break;
+    default: break;
+  }
+  return original;
+}
+
 void fli_reset(struct Proto *p, Instruction *i) {
   size_t extidx, removed;
   fll_assert(fli_isfl(i), "invalid opcode");
@@ -49,8 +66,9 @@ void fli_reset(struct Proto *p, Instruction *i) {
   }
 }
 
-/* Convert a instruction to a fl instruction */
-static void convertinstr(struct Proto *p, Instruction *i, enum FLOpcode flop) {
+/* Convert a instruction to a fl instruction and return its extension. */
+static struct FLInstrExt *convertinstr(struct Proto *p, Instruction *i,
+                                       enum FLOpcode flop) {
   size_t extidx = fliv_size(flivec(p));
   struct FLInstrExt ext;
   memset(&ext, 0, sizeof(struct FLInstrExt));
@@ -60,18 +78,37 @@ static void convertinstr(struct Proto *p, Instruction *i, enum FLOpcode flop) {
   SET_OPCODE(*i, OP_FLVM);
   fli_setflop(i, flop);
   fli_setextindex(i, extidx);
+  return fliv_getref(flivec(p), extidx);
 }
 
 void fli_toprof(struct Proto *p, Instruction *i) {
   switch (GET_OPCODE(*i)) {
-    case OP_FORPREP:    convertinstr(p, i, FLOP_FORPREP_PROF); break;
+    case OP_FORPREP: {
+      struct FLInstrExt *ext = convertinstr(p, i, FLOP_FORPREP_PROF);
+      ext->u.prof.threshold = FL_JIT_THRESHOLD;
+      break;
+    }
+    case OP_TFORCALL: {
+      struct FLInstrExt *ext = convertinstr(p, i, FLOP_TFORCALL_PROF);
+      ext->u.prof.threshold = FL_JIT_THRESHOLD;
+      break;
+    }
+    default: break;
+  }
+}
+
+void fli_torec(struct Proto *p, Instruction *i) {
+  switch (GET_OPCODE(*i)) {
+    case OP_FORLOOP:
+    case OP_TFORLOOP:   convertinstr(p, i, FLOP_LOOP_REC); break;
     default: break;
   }
 }
 
 void fli_tojit(struct Proto *p, Instruction *i) {
   switch (GET_OPCODE(*i)) {
-    case OP_FORLOOP:    convertinstr(p, i, FLOP_FORLOOP_EXEC); break;
+    case OP_FORLOOP:
+    case OP_TFORLOOP:   convertinstr(p, i, FLOP_LOOP_EXEC); break;
     default: break;
   }
 }
@@ -32,6 +32,11 @@
  * The extension vector only contains data about the converted instructions.
  * Finaly, the B argument is used to store the index of the instruction's
  * extension.
+ *
+ * The interpreter also quickens some instructions: the opcode is replaced by
+ * one specialized for the operand types observed (eg. OP_ADDII). Quickened
+ * instructions keep their arguments, so they don't need an extension, and
+ * they are rewritten back to the generic opcode on a type miss.
  */
 
 #ifndef fl_instr_h
@@ -46,7 +51,9 @@ struct Proto;
 /* FL opcodes. These opcodes are executed in the fl_vm. */
 enum FLOpcode {
   FLOP_FORPREP_PROF,
-  FLOP_FORLOOP_EXEC
+  FLOP_TFORCALL_PROF,
+  FLOP_LOOP_REC,
+  FLOP_LOOP_EXEC
 };
 
 /* Extra information about a FL instruction. */
@@ -54,7 +61,11 @@ struct FLInstrExt {
   Instruction original;             /* original instruction */
   Instruction *address;             /* original instruction address */
   union {
-    int count;                      /* number of times executed */
+    struct {
+      int count;                    /* number of times executed */
+      int threshold;                /* executions required to record */
+      int nfails;                   /* number of failed attempts */
+    } prof;
     struct AsmInstrData *asmdata;   /* compiled function */
   } u;
 };
@@ -71,6 +82,17 @@ TSCC_DECL_VECTOR(FLInstrExtVector, fliv_, struct FLInstrExt)
 /* Obtain the current instruction. */
 #define fli_currentinstr(ci, p)     (Instruction *)(ci->u.l.savedpc - 1)
 
+/* Obtain the loop instruction (FORLOOP or TFORLOOP) given the profiling
+ * instruction (FORPREP or TFORCALL) and vice versa. The original instruction
+ * is required because the opcode and the jump offset can't be read from a FL
+ * instruction. */
+#define fli_getloop(prof, orig) \
+    (GET_OPCODE(orig) == OP_FORPREP ? (prof) + 1 + GETARG_sBx(orig) \
+                                    : (prof) + 1)
+#define fli_getprof(loop, orig) \
+    (GET_OPCODE(orig) == OP_FORLOOP ? (loop) + GETARG_sBx(orig) \
+                                    : (loop) - 1)
+
 /* Foreach instruction in the proto. */
 #define fli_foreach(p, i, cmd) \
   do { \
@@ -88,17 +110,28 @@ TSCC_DECL_VECTOR(FLInstrExtVector, fliv_, struct FLInstrExt)
 #define fli_setextindex(i, idx)     (SETARG_B(*i, idx))
 #define fli_isfl(i)                 (GET_OPCODE(*i) == OP_FLVM)
 #define fli_isexec(i) \
-    (fli_isfl(i) && fli_getflop(i) >= FLOP_FORLOOP_EXEC)
+    (fli_isfl(i) && fli_getflop(i) >= FLOP_LOOP_EXEC)
+
+/* Rewrite the opcode of the current instruction (quickening). */
+#define fli_quicken(ci, op) \
+    SET_OPCODE(*fli_currentinstr(ci, NULL), op)
 
 /* Obtain the instruction's extension. */
 struct FLInstrExt *fli_getext(struct Proto *p, Instruction *i);
 
+/* Obtain the original instruction (the instruction itself if it isn't a FL
+ * instruction, with the generic opcode if it is quickened). */
+Instruction fli_getoriginal(struct Proto *p, Instruction *i);
+
 /* Convert an instruction back to the original one. */
 void fli_reset(struct Proto *p, Instruction *i);
 
 /* Convert an instruction to the profiling one. */
 void fli_toprof(struct Proto *p, Instruction *i);
 
+/* Convert an instruction to the one that starts the recording. */
+void fli_torec(struct Proto *p, Instruction *i);
+
 /* Convert an instruction to the jit one. */
 void fli_tojit(struct Proto *p, Instruction *i);
 
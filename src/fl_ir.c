@@ -206,6 +206,18 @@ IRValue _ir_phi(IRFunction *F, enum IRType type) {
   return lastvalue(F);
 }
 
+IRValue _ir_call(IRFunction *F, enum IRType type, IRCFunction func, int nargs,
+                 IRValue *args) {
+  IRInstr *i = createinstr(F, type, IR_CALL);
+  int j;
+  fll_assert(nargs <= IR_MAXARGS, "too many call arguments");
+  i->args.call.func = func;
+  i->args.call.nargs = nargs;
+  for (j = 0; j < nargs; ++j)
+    i->args.call.args[j] = args[j];
+  return lastvalue(F);
+}
+
 void _ir_addphiinc(IRFunction *F, IRValue phi, IRValue value, IRName bblock) {
   IRInstr *pi = _ir_instr(F, phi);
   IRInstr *vi = _ir_instr(F, value);
@@ -240,7 +252,7 @@ static void printconst(IRInstr *i) {
   fllog(" ");
   switch (i->type) {
     case IR_CHAR: case IR_SHORT: case IR_INT: case IR_LUAINT: case IR_LONG:
-      fllog("%td", i->args.konst.i);
+      fllog("%lld", i->args.konst.i);
       break;
     case IR_PTR:    fllog("%p", i->args.konst.p); break;
     case IR_FLOAT:  fllog("%f", i->args.konst.f); break;
@@ -255,6 +267,11 @@ static void printbinop(enum IRBinOp op) {
     case IR_SUB: fllog("sub"); break;
     case IR_MUL: fllog("mul"); break;
     case IR_DIV: fllog("div"); break;
+    case IR_BAND: fllog("band"); break;
+    case IR_BOR: fllog("bor"); break;
+    case IR_BXOR: fllog("bxor"); break;
+    case IR_SHL: fllog("shl"); break;
+    case IR_SHR: fllog("shr"); break;
   }
 }
 
@@ -374,6 +391,16 @@ static void printinstr(IRFunction *F, IRInstr *i) {
       fllog(">]");
       break;
     }
+    case IR_CALL: {
+      int j, n = i->args.call.nargs;
+      fllog("call 0x%zx(", (size_t)i->args.call.func);
+      for (j = 0; j < n; ++j) {
+        printvalue(F, i->args.call.args[j]);
+        if (j != n - 1) fllog(", ");
+      }
+      fllog(")");
+      break;
+    }
   }
   fllog(" : ");
   printtype(i->type);
@@ -46,7 +46,7 @@
 
 /* Lua definitions */
 struct lua_State;
-typedef lua_Integer IRInt;
+typedef long long IRInt;      /* wide enough for lua_Integer and addresses */
 typedef lua_Number IRFloat;
 
 /* Basic blocks and instructions are referenced by indices. */
@@ -75,20 +75,26 @@ enum IRInstrTag {
   IR_CMP,
   IR_JMP,
   IR_RET,
-  IR_PHI
+  IR_PHI,
+  IR_CALL
 };
 
 /* Binary operations. */
 enum IRBinOp {
-  IR_ADD = IR_PHI + 1,
+  IR_ADD = IR_CALL + 1,
   IR_SUB,
   IR_MUL,
-  IR_DIV
+  IR_DIV,
+  IR_BAND,
+  IR_BOR,
+  IR_BXOR,
+  IR_SHL,                       /* shift count must be in [0, 63] */
+  IR_SHR                        /* logical, same restriction of IR_SHL */
 };
 
 /* Comparison operations. */
 enum IRCmpOp {
-  IR_NE = IR_DIV + 1,
+  IR_NE = IR_SHR + 1,
   IR_EQ,
   IR_LE,
   IR_LT,
@@ -96,6 +102,12 @@ enum IRCmpOp {
   IR_GT
 };
 
+/* Runtime function called by the compiled code. */
+typedef void (*IRCFunction)(void);
+
+/* Maximum number of arguments in a call. */
+#define IR_MAXARGS 6
+
 /* Values are references to a instruction inside a basic block. */
 typedef struct IRValue {
   IRName bblock;
@@ -130,6 +142,7 @@ typedef struct IRInstr {
     struct { IRName dest; } jmp;
     struct { IRValue val; } ret;
     struct { IRPhiIncVector inc; } phi;
+    struct { IRCFunction func; int nargs; IRValue args[IR_MAXARGS]; } call;
   } args;
 } IRInstr;
 
@@ -213,6 +226,8 @@ IRValue _ir_cmp(IRFunction *F, enum IRCmpOp op, IRValue lhs, IRValue rhs,
 IRValue _ir_jmp(IRFunction *F, IRName dest);
 IRValue _ir_return(IRFunction *F, IRValue v);
 IRValue _ir_phi(IRFunction *F, enum IRType type);
+IRValue _ir_call(IRFunction *F, enum IRType type, IRCFunction func, int nargs,
+                 IRValue *args);
 #define ir_consti(i, type) _ir_consti(_irfunc, i, type)
 #define ir_constf(f) _ir_constf(_irfunc, f)
 #define ir_constp(p) _ir_constp(_irfunc, p)
@@ -225,6 +240,8 @@ IRValue _ir_phi(IRFunction *F, enum IRType type);
 #define ir_jmp(bb) _ir_jmp(_irfunc, bb)
 #define ir_return(v) _ir_return(_irfunc, v)
 #define ir_phi(type) _ir_phi(_irfunc, type)
+#define ir_call(type, func, nargs, args) \
+    _ir_call(_irfunc, type, (IRCFunction)(func), nargs, args)
 
 /* Add a phi incoming value to the phi instruction. */
 void _ir_addphiinc(IRFunction *F, IRValue phi, IRValue value, IRName bblock);
@@ -28,12 +28,18 @@
 #include "lmem.h"
 #include "lopcodes.h"
 #include "lstate.h"
+#include "ltable.h"
+#include "lvm.h"
 
 #include "fl_asm.h"
 #include "fl_instr.h"
 #include "fl_ir.h"
 #include "fl_jitc.h"
 #include "fl_logger.h"
+#include "fl_vm.h"
+
+/* Number of bits in a lua_Integer (same of lvm.c). */
+#define NBITS   cast_int(sizeof(lua_Integer) * CHAR_BIT)
 
 /* IRFunction implict parameter. */
 #define _irfunc (&J->irfunc)
@@ -46,6 +52,7 @@ struct JitExit {
   IRValue *values;              /* register's values */
   int *tags;                    /* register's tags */
   int status;                   /* return status */
+  const Instruction *pc;        /* resume point of a side exit */
 };
 
 /* JitExit container */
@@ -71,7 +78,16 @@ typedef struct JitState {
   IRName loopstart;             /* first block in the loop */
   IRName loopend;               /* last block in the loop */
   IRName earlyexit;             /* side exit before the loop started */
+  IRName innerexit;             /* a call left the trace (pc already set) */
   JitExitVector exits;          /* exits that must restore the lua stack */
+  const Instruction *currpc;    /* instruction being compiled */
+  const lu_byte *loadtags;      /* register tags after the last inner trace */
+  int hascall;                  /* the trace calls inner traces */
+  IRValue cursor;               /* position of the next() traversal */
+  IRValue cursorphi;            /* phi value of the cursor */
+  IRValue forlimit;             /* limit of the trace loop */
+  IRValue forstep;              /* step of the trace loop */
+  IRValue nvarargs;             /* number of varargs of the function */
   IRValue lstate;               /* Lua state in the jitted code */
   IRValue base;                 /* Lua stack base */
   int nregisters;               /* number of registers in Lua stack */
@@ -90,7 +106,14 @@ static JitState *createjitstate(lua_State *L, TraceRecording *tr) {
   J->loopstart = IRNull;
   J->loopend = IRNull;
   J->earlyexit = IRNull;
+  J->innerexit = IRNull;
   exvec_create(&J->exits, J->L);
+  J->currpc = NULL;
+  J->loadtags = NULL;
+  J->hascall = 0;
+  J->cursor = J->cursorphi = ir_nullvalue();
+  J->forlimit = J->forstep = ir_nullvalue();
+  J->nvarargs = ir_nullvalue();
   J->lstate = J->base = ir_nullvalue();
   J->nregisters = n;
   J->r = luaM_newvector(L, n, struct JitRegData);
@@ -114,34 +137,137 @@ static enum IRType converttag(int tag) {
   switch (tag & 0x3F) {
     case LUA_TNUMFLT: return IR_FLOAT;
     case LUA_TNUMINT: return IR_LUAINT;
-    case LUA_TSHRSTR:
-    case LUA_TLNGSTR:
+    case LUA_TNIL:
+    case LUA_TBOOLEAN:
+        return IR_INT;
+    default: /* collectable objects, light userdata and light C functions */
         return IR_PTR;
-    default: fll_error("unhandled tag"); break;
   }
-  return 0;
 }
 
+/* Access to the TValues in memory. The loaded tag is only compared by
+ * guardtag; with NaN boxing it is the tag index of the word, whose low half
+ * holds the integers and booleans (little-endian). */
+#if !defined(LUA_NANBOXING)
+static IRValue loadtag(JitState *J, IRValue addr, int offset) {
+  return ir_load(IR_INT, addr, offset + offsetof(TValue, tt_));
+}
+
+/* Jump to dest if the loaded tag is (IR_EQ) or isn't (IR_NE) 'tag'. */
+static void guardtag(JitState *J, enum IRCmpOp op, IRValue loaded, int tag,
+                     IRName dest) {
+  ir_cmp(op, loaded, ir_consti(tag, IR_INT), dest);
+}
+
+static IRValue loadvalue(JitState *J, IRValue addr, int offset, int tag) {
+  return ir_load(converttag(tag), addr, offset + offsetof(TValue, value_));
+}
+
+static void storevalue(JitState *J, IRValue addr, int offset, IRValue v,
+                       int tag) {
+  ir_store(addr, v, offset + offsetof(TValue, value_));
+  ir_store(addr, ir_consti(tag, IR_INT), offset + offsetof(TValue, tt_));
+}
+#else
+static IRValue loadtag(JitState *J, IRValue addr, int offset) {
+  IRValue w = ir_load(IR_LONG, addr, offset);
+  return ir_binop(IR_SHR, w, ir_consti(NB_TAGSHIFT, IR_LONG));
+}
+
+static void guardtag(JitState *J, enum IRCmpOp op, IRValue loaded, int tag,
+                     IRName dest) {
+  if (tag == LUA_TNUMFLT)
+    ir_cmp(op == IR_EQ ? IR_LE : IR_GT, loaded,
+           ir_consti(NB_BOXED, IR_LONG), dest);
+  else
+    ir_cmp(op, loaded, ir_consti(NB_BOXED + luaO_nbindex[tag], IR_LONG),
+           dest);
+}
+
+static IRValue loadvalue(JitState *J, IRValue addr, int offset, int tag) {
+  enum IRType type = converttag(tag);
+  if (type == IR_PTR) {
+    IRValue w = ir_load(IR_LONG, addr, offset);
+    w = ir_binop(IR_BAND, w, ir_consti(NB_PAYLOAD, IR_LONG));
+    return ir_cast(w, IR_PTR);
+  }
+  return ir_load(type, addr, offset);
+}
+
+static void storevalue(JitState *J, IRValue addr, int offset, IRValue v,
+                       int tag) {
+  enum IRType type = converttag(tag);
+  NBValue tagbits = (tag == LUA_TNUMFLT) ? 0 : nb_tagbits(luaO_nbindex[tag]);
+  if (type == IR_FLOAT)
+    ir_store(addr, v, offset);
+  else if (type == IR_PTR) {
+    IRValue w = ir_binop(IR_BOR, ir_cast(v, IR_LONG),
+                         ir_consti(cast(IRInt, tagbits), IR_LONG));
+    ir_store(addr, w, offset);
+  }
+  else {
+    ir_store(addr, v, offset);
+    ir_store(addr, ir_consti(cast(IRInt, tagbits >> 32), IR_INT), offset + 4);
+  }
+}
+#endif
+
 /* Convert the lua binary operation to the ir binop. */
 static enum IRBinOp convertbinop(int op) {
   switch (op) {
     case OP_ADD: return IR_ADD;
+    case OP_SUB: return IR_SUB;
+    case OP_MUL: return IR_MUL;
+    case OP_BAND: return IR_BAND;
+    case OP_BOR: return IR_BOR;
+    case OP_BXOR: return IR_BXOR;
     default: fll_error("convertbinop: unhandled binop"); break;
   }
   return 0;
 }
 
-/* Load a register from Lua stack. */
+/* Create an exit block and add it to the jit state. */
+static IRName addexit(JitState *J, int status, const Instruction *pc) {
+  int i, currindex = 0, ntostore = 0;
+  struct JitExit e;
+  /* compute the number of registers that will be stored */
+  for (i = 0; i < J->tr->p->maxstacksize; ++i)
+    if (J->r[i].set && !ir_isnullvalue(J->r[i].current))
+      ntostore++;
+  /* create the exit */
+  e.bb = ir_addbblock();
+  e.ntostore = ntostore;
+  e.indices = luaM_newvector(J->L, ntostore, int);
+  e.values = luaM_newvector(J->L, ntostore, IRValue);
+  e.tags = luaM_newvector(J->L, ntostore, int);
+  e.status = status;
+  e.pc = pc;
+  exvec_push(&J->exits, e);
+  /* save the values that will be stored for later */
+  for (i = 0; i < J->tr->p->maxstacksize; ++i) {
+    if (J->r[i].set && !ir_isnullvalue(J->r[i].current)) {
+      e.indices[currindex] = i;
+      e.values[currindex] = J->r[i].current;
+      e.tags[currindex++] = J->r[i].tag;
+    }
+  }
+  return e.bb;
+}
+
+/* Load a register from Lua stack. Before the loop starts and before any inner
+ * trace is called, the stack is untouched and a tag mismatch is an early exit.
+ * Otherwise, the trace leaves at the current instruction. */
 static void loadregister(JitState *J, int i, int checktag) {
   struct TraceRegister *treg = J->tr->regs + i;
-  enum IRType type = converttag(treg->loadedtag);
-  int expectedtag = treg->loadedtag;
+  int expectedtag = J->loadtags ? J->loadtags[i] : treg->loadedtag;
   int addr = sizeof(TValue) * i;
   if (checktag) {
-    IRValue tag = ir_load(IR_INT, J->base, addr + offsetof(TValue, tt_));
-    ir_cmp(IR_NE, tag, ir_consti(expectedtag, IR_INT), J->earlyexit);
+    IRName exit = (J->insideloop || J->loadtags) ?
+        addexit(J, FL_SIDE_EXIT, J->currpc) : J->earlyexit;
+    IRValue tag = loadtag(J, J->base, addr);
+    guardtag(J, IR_NE, tag, expectedtag, exit);
   }
-  J->r[i].current = ir_load(type, J->base, addr + offsetof(TValue, value_));
+  J->r[i].current = loadvalue(J, J->base, addr, expectedtag);
   J->r[i].tag = expectedtag;
 }
 
@@ -149,16 +275,35 @@ static void loadregister(JitState *J, int i, int checktag) {
 static void createphivalues(JitState *J) {
   int i;
   for (i = 0; i < J->tr->p->maxstacksize; ++i) {
-    struct TraceRegister *treg = J->tr->regs + i;
     struct JitRegData *r = J->r + i;
     if (r->set) {
-      r->phi = ir_phi(converttag(treg->tag));
+      /* the snapshot tag of a dead register may be nil after a GC */
+      r->phi = ir_phi(converttag(r->tag));
       ir_addphiinc(r->phi, r->current, J->preloop);
       r->current = r->phi;
     }
+    else if (J->hascall) {
+      /* the value may be changed by an inner trace */
+      r->current = ir_nullvalue();
+    }
+  }
+  if (!ir_isnullvalue(J->cursor)) {
+    J->cursorphi = ir_phi(IR_LUAINT);
+    ir_addphiinc(J->cursorphi, J->cursor, J->preloop);
+    J->cursor = J->cursorphi;
   }
 }
 
+/* Reload the set registers that were invalidated by an inner trace, so they
+ * can be used as phi values. */
+static void reloadsetregisters(JitState *J) {
+  int i;
+  J->currpc = J->tr->start;
+  for (i = 0; i < J->nregisters; ++i)
+    if (J->r[i].set && ir_isnullvalue(J->r[i].current))
+      loadregister(J, i, 1);
+}
+
 /* Load a constant from the constant table. */
 static IRValue getconst(JitState *J, int kpos, int *tag) {
   TValue *k = J->tr->p->k + kpos;
@@ -186,21 +331,9 @@ static IRValue gettvalue(JitState *J, int pos, int *tag) {
   }
 }
 
-/* Load a forloop register. Search near instructions to see if the register is
- * in fact a constant. */
-static IRValue getforloopvalue(JitState* J, int pos, const Instruction *fli) {
-  const Instruction *i;
-  for (i = fli - 1; i != fli - 4; --i)
-    if (GET_OPCODE(*i) == OP_LOADK && GETARG_A(*i) == pos)
-      return getconst(J, GETARG_Bx(*i), NULL);
-  return gettvalue(J, pos, NULL);
-}
-
 /* Store a Lua stack register */
 static void storeregister(JitState *J, int regpos, IRValue value, int tag) {
-  int addr = sizeof(TValue) * regpos;
-  ir_store(J->base, value, addr + offsetof(TValue, value_));
-  ir_store(J->base, ir_consti(tag, IR_INT), addr + offsetof(TValue, tt_));
+  storevalue(J, J->base, sizeof(TValue) * regpos, value, tag);
 }
 
 /* Create the phi nodes for the registers that have phi values. */
@@ -211,6 +344,8 @@ static void linkphivalues(JitState *J) {
     if (!ir_isnullvalue(r->phi))
       ir_addphiinc(r->phi, r->current, J->loopend);
   }
+  if (!ir_isnullvalue(J->cursorphi))
+    ir_addphiinc(J->cursorphi, J->cursor, J->loopend);
 }
 
 /* Define the Lua register value. */
@@ -221,50 +356,517 @@ static void setregister(JitState *J, int i, IRValue value, int tag) {
   r->set = 1;
 }
 
-/* Create an exit block and add it to the jit state. */
-static IRName addexit(JitState *J, int status) {
-  int i, currindex = 0, ntostore = 0;
-  struct JitExit e;
-  /* compute the number of registers that will be stored */
-  for (i = 0; i < J->tr->p->maxstacksize; ++i)
-    if (J->r[i].set && !ir_isnullvalue(J->r[i].current))
-      ntostore++;
-  /* create the exit */
-  e.bb = ir_addbblock();
-  e.ntostore = ntostore;
-  e.indices = luaM_newvector(J->L, ntostore, int);
-  e.values = luaM_newvector(J->L, ntostore, IRValue);
-  e.tags = luaM_newvector(J->L, ntostore, int);
-  e.status = status;
-  exvec_push(&J->exits, e);
-  /* save the values that will be stored for later */
-  for (i = 0; i < J->tr->p->maxstacksize; ++i) {
-    if (J->r[i].set && !ir_isnullvalue(J->r[i].current)) {
-      e.indices[currindex] = i;
-      e.values[currindex] = J->r[i].current;
-      e.tags[currindex++] = J->r[i].tag;
-    }
-  }
-  return e.bb;
-}
-
 /* Store the registers back in the Lua stack. */
 static void closeexit(JitState *J, struct JitExit *e) {
   int i;
   ir_setbblock(e->bb);
   for (i = 0; i < e->ntostore; ++i)
     storeregister(J, e->indices[i], e->values[i], e->tags[i]);
+  if (e->pc) {
+    IRValue ci = ir_load(IR_PTR, J->lstate, offsetof(lua_State, ci));
+    ir_store(ci, ir_constp((void *)e->pc), offsetof(CallInfo, u.l.savedpc));
+  }
   ir_return(ir_consti(e->status, IR_LONG));
   luaM_freearray(J->L, e->indices, e->ntostore);
   luaM_freearray(J->L, e->values, e->ntostore);
+  luaM_freearray(J->L, e->tags, e->ntostore);
+}
+
+/* Store the registers changed by the trace in the Lua stack. */
+static void syncregisters(JitState *J) {
+  int i;
+  for (i = 0; i < J->nregisters; ++i) {
+    struct JitRegData *r = J->r + i;
+    if (r->set && !ir_isnullvalue(r->current))
+      storeregister(J, i, r->current, r->tag);
+  }
+}
+
+/* Execute the trace of an inner loop. The registers are synchronized with
+ * the Lua stack before the call and reloaded after it. */
+static void compilecall(JitState *J, struct TraceInstr *ti) {
+  int i;
+  IRValue args[4], ret;
+  syncregisters(J);
+  args[0] = J->lstate;
+  args[1] = J->base;
+  args[2] = ir_constp(J->tr->p);
+  args[3] = ir_constp((void *)ti->instr);
+  ret = ir_call(IR_INT, flvm_calltrace, 4, args);
+  /* the inner trace already set the resume point */
+  ir_cmp(IR_EQ, ret, ir_consti(FL_SIDE_EXIT, IR_INT), J->innerexit);
+  /* the inner trace didn't start, so resume at the inner loop */
+  ir_cmp(IR_NE, ret, ir_consti(FL_SUCCESS, IR_INT),
+         addexit(J, FL_SIDE_EXIT, ti->instr));
+  for (i = 0; i < J->nregisters; ++i)
+    J->r[i].current = ir_nullvalue();
+  J->loadtags = flt_tagvec_getref(&J->tr->calltags, ti->u.call.tags);
+  J->hascall = 1;
+}
+
+/* Shift with the Lua semantics (see luaV_shiftl). Constant counts are
+ * resolved at compile time, the others are computed by the runtime. */
+static void compileshift(JitState *J, struct TraceInstr *ti) {
+  Instruction i = ti->original;
+  int op = GET_OPCODE(i);
+  int c = GETARG_C(i);
+  IRValue rb = gettvalue(J, GETARG_B(i), NULL);
+  IRValue result;
+  if (ISK(c)) {
+    lua_Integer y = ivalue(J->tr->p->k + INDEXK(c));
+    if (op == OP_SHR) y = intop(-, 0, y);
+    if (y <= -(lua_Integer)NBITS || y >= (lua_Integer)NBITS)
+      result = ir_consti(0, IR_LUAINT);
+    else if (y < 0)
+      result = ir_binop(IR_SHR, rb, ir_consti(-y, IR_LUAINT));
+    else
+      result = ir_binop(IR_SHL, rb, ir_consti(y, IR_LUAINT));
+  }
+  else {
+    IRValue args[2];
+    IRValue rc = gettvalue(J, c, NULL);
+    if (op == OP_SHR) rc = ir_binop(IR_SUB, ir_consti(0, IR_LUAINT), rc);
+    args[0] = rb;
+    args[1] = rc;
+    result = ir_call(IR_LUAINT, luaV_shiftl, 2, args);
+  }
+  setregister(J, GETARG_A(i), result, LUA_TNUMINT);
+}
+
+/* Obtain the length of a string or a table without metatable. */
+static void compilelen(JitState *J, int a, int b) {
+  int tag;
+  IRValue rb = gettvalue(J, b, &tag);
+  IRValue len;
+  if (tag == ctb(LUA_TSHRSTR)) {
+    len = ir_load(IR_CHAR, rb, offsetof(TString, shrlen));
+  }
+  else if (tag == ctb(LUA_TLNGSTR)) {
+    len = ir_load(IR_LONG, rb, offsetof(TString, u.lnglen));
+  }
+  else {
+    IRValue mt = ir_load(IR_PTR, rb, offsetof(Table, metatable));
+    ir_cmp(IR_NE, mt, ir_constp(NULL), addexit(J, FL_SIDE_EXIT, J->currpc));
+    len = ir_call(IR_INT, luaH_getn, 1, &rb);
+  }
+  setregister(J, a, ir_cast(len, IR_LUAINT), LUA_TNUMINT);
+}
+
+/* Concatenate the registers with a runtime call. The result and the operands
+ * (converted to strings) are reloaded from the stack when needed. */
+static void compileconcat(JitState *J, struct TraceInstr *ti) {
+  Instruction i = ti->original;
+  int r;
+  IRValue args[2], ret;
+  for (r = GETARG_B(i); r <= GETARG_C(i); ++r)
+    gettvalue(J, r, NULL); /* check the operand tags */
+  syncregisters(J);
+  args[0] = J->lstate;
+  args[1] = ir_constp((void *)ti->instr);
+  ret = ir_call(IR_INT, flvm_concat, 2, args);
+  /* the stack moved, the helper already set the resume point */
+  ir_cmp(IR_NE, ret, ir_consti(FL_SUCCESS, IR_INT), J->innerexit);
+  J->r[GETARG_A(i)].current = ir_nullvalue();
+  J->r[GETARG_A(i)].set = 1;
+  for (r = GETARG_B(i); r <= GETARG_C(i); ++r)
+    J->r[r].current = ir_nullvalue();
+  J->loadtags = flt_tagvec_getref(&J->tr->calltags, ti->u.call.tags);
+}
+
+/* Obtain the C function of a fast path. */
+static lua_CFunction getbuiltin(int builtin) {
+  switch (builtin) {
+    case FLB_STRBYTE: return flstr_byte;
+    case FLB_STRSUB:  return flstr_sub;
+    case FLB_STRCHAR: return flstr_char;
+    case FLB_SELECT:
+    case FLB_SELECTCOUNT: return flbase_select;
+    default: fll_error("getbuiltin: invalid builtin"); break;
+  }
+  return NULL;
+}
+
+/* The results of a runtime call are reloaded from the stack when needed and
+ * the registers above them are dead. */
+static void invalidateresults(JitState *J, struct TraceInstr *ti, int a,
+                              int nresults) {
+  int r;
+  for (r = a; r < J->nregisters; ++r) {
+    J->r[r].current = ir_nullvalue();
+    J->r[r].set = (r < a + nresults);
+  }
+  J->loadtags = flt_tagvec_getref(&J->tr->calltags, ti->u.call.tags);
+}
+
+/* Obtain the number of varargs, which is computed once from the function
+ * position (see OP_VARARG in lvm.c). */
+static IRValue getnvarargs(JitState *J) {
+  if (ir_isnullvalue(J->nvarargs)) {
+    IRValue ci = ir_load(IR_PTR, J->lstate, offsetof(lua_State, ci));
+    IRValue func = ir_load(IR_PTR, ci, offsetof(CallInfo, func));
+    IRValue size = ir_binop(IR_SUB, ir_cast(J->base, IR_LONG),
+                            ir_cast(func, IR_LONG));
+    IRValue n = ir_binop(IR_DIV, size, ir_consti(sizeof(TValue), IR_LONG));
+    J->nvarargs = ir_binop(IR_SUB, n,
+                           ir_consti(J->tr->p->numparams + 1, IR_LONG));
+  }
+  return J->nvarargs;
+}
+
+/* Copy the varargs starting at 'first' to the registers. The presence and
+ * the tag of each vararg must be the same of the recording, where the first
+ * vararg was 'recfirst'. */
+static void setvarargs(JitState *J, struct TraceInstr *ti, int a,
+                       int nresults, IRValue first, int recfirst) {
+  const lu_byte *tags = flt_tagvec_getref(&J->tr->calltags, ti->u.call.tags);
+  IRValue n = getnvarargs(J);
+  IRName exit = addexit(J, FL_SIDE_EXIT, J->currpc);
+  int k;
+  for (k = 0; k < nresults; ++k) {
+    IRValue idx = ir_binop(IR_ADD, first, ir_consti(k, IR_LONG));
+    if (recfirst + k < ti->u.call.nvarargs) {
+      int tag = tags[a + k];
+      IRValue offset = ir_binop(IR_MUL, ir_binop(IR_SUB, n, idx),
+                                ir_consti(sizeof(TValue), IR_LONG));
+      IRValue addr = ir_cast(ir_binop(IR_SUB, ir_cast(J->base, IR_LONG),
+                                      offset), IR_PTR);
+      ir_cmp(IR_LT, idx, ir_consti(0, IR_LONG), exit);
+      ir_cmp(IR_GE, idx, n, exit);
+      guardtag(J, IR_NE, loadtag(J, addr, 0), tag, exit);
+      setregister(J, a + k, loadvalue(J, addr, 0, tag), tag);
+    }
+    else {
+      ir_cmp(IR_LT, idx, n, exit);
+      setregister(J, a + k, ir_consti(0, IR_INT), LUA_TNIL);
+    }
+  }
+}
+
+/* Copy the varargs to the registers. The open form is only executed when the
+ * next call doesn't have a fast path that reads them from the stack. */
+static void compilevararg(JitState *J, struct TraceInstr *ti) {
+  Instruction i = ti->original;
+  int a = GETARG_A(i);
+  int r;
+  IRValue args[2], ret;
+  if (GETARG_B(i) != 0) {
+    setvarargs(J, ti, a, GETARG_B(i) - 1, ir_consti(0, IR_LONG), 0);
+    return;
+  }
+  if (ti->u.call.builtin != FLB_NONE)
+    return;
+  syncregisters(J);
+  args[0] = J->lstate;
+  args[1] = ir_constp((void *)ti->instr);
+  ret = ir_call(IR_INT, flvm_vararg, 2, args);
+  /* the stack moved, the helper already set the resume point */
+  ir_cmp(IR_NE, ret, ir_consti(FL_SUCCESS, IR_INT), J->innerexit);
+  for (r = a; r < J->nregisters; ++r) {
+    J->r[r].current = ir_nullvalue();
+    J->r[r].set = 0;
+  }
+}
+
+/* Fast paths of select('#', ...) and select(i, ...), with the varargs read
+ * directly from the stack. A side exit resumes at the open OP_VARARG. */
+static void compileselect(JitState *J, struct TraceInstr *ti, IRValue index) {
+  Instruction i = ti->original;
+  int a = GETARG_A(i);
+  int nresults = GETARG_C(i) - 1;
+  IRValue n = getnvarargs(J);
+  IRName exit = addexit(J, FL_SIDE_EXIT, J->currpc);
+  IRValue first;
+  int r;
+  if (ti->u.call.builtin == FLB_SELECTCOUNT) {
+    setregister(J, a, ir_cast(n, IR_LUAINT), LUA_TNUMINT);
+    for (r = 1; r < nresults; ++r)
+      setregister(J, a + r, ir_consti(0, IR_INT), LUA_TNIL);
+    return;
+  }
+  index = ir_cast(index, IR_LONG);
+  if (ti->u.call.index > 0) {
+    ir_cmp(IR_LT, index, ir_consti(1, IR_LONG), exit);
+    first = ir_binop(IR_SUB, index, ir_consti(1, IR_LONG));
+    setvarargs(J, ti, a, nresults, first, ti->u.call.index - 1);
+  }
+  else {
+    /* the index can't be before the first vararg */
+    ir_cmp(IR_GT, index, ir_consti(-1, IR_LONG), exit);
+    first = ir_binop(IR_ADD, n, index);
+    ir_cmp(IR_LT, first, ir_consti(0, IR_LONG), exit);
+    setvarargs(J, ti, a, nresults, first,
+               ti->u.call.nvarargs + ti->u.call.index);
+  }
+}
+
+/* Call a C function. The functions with fast paths are called directly,
+ * without the Lua call protocol. */
+static void compileccall(JitState *J, struct TraceInstr *ti) {
+  Instruction i = ti->original;
+  int a = GETARG_A(i);
+  int nargs = GETARG_B(i) - 1;
+  int builtin = ti->u.call.builtin;
+  IRValue func, ret, args[5];
+  IRValue fargs[3]; /* fast path arguments */
+  int r;
+  if (nargs < 0) {
+    /* the arguments end with the varargs, so resume at OP_VARARG */
+    J->currpc = ti->instr - 1;
+    nargs = GETARG_A(*J->currpc) - a - 1;
+  }
+  func = gettvalue(J, a, NULL);
+  for (r = 0; r < nargs; ++r) {
+    IRValue v = gettvalue(J, a + 1 + r, NULL); /* check the argument tags */
+    if (r < 3) fargs[r] = v;
+  }
+  if (builtin != FLB_NONE) {
+    IRInt f = cast(IRInt, cast(size_t, getbuiltin(builtin)));
+    ir_cmp(IR_NE, ir_cast(func, IR_LONG), ir_consti(f, IR_LONG),
+           addexit(J, FL_SIDE_EXIT, J->currpc));
+  }
+  args[0] = J->lstate;
+  args[1] = ir_constp((void *)ti->instr);
+  switch (builtin) {
+    case FLB_STRBYTE: {
+      IRValue v;
+      args[0] = fargs[0];
+      args[1] = (nargs == 2) ? fargs[1] : ir_consti(1, IR_LUAINT);
+      v = ir_call(IR_LUAINT, flvm_strbyte, 2, args);
+      ir_cmp(IR_LT, v, ir_consti(0, IR_LUAINT),
+             addexit(J, FL_SIDE_EXIT, J->currpc));
+      setregister(J, a, v, LUA_TNUMINT);
+      return;
+    }
+    case FLB_STRSUB: {
+      args[2] = fargs[0];
+      args[3] = fargs[1];
+      args[4] = (nargs == 3) ? fargs[2] : ir_consti(-1, IR_LUAINT);
+      syncregisters(J);
+      ret = ir_call(IR_INT, flvm_strsub, 5, args);
+      break;
+    }
+    case FLB_STRCHAR: {
+      IRName exit = addexit(J, FL_SIDE_EXIT, J->currpc);
+      ir_cmp(IR_LT, fargs[0], ir_consti(0, IR_LUAINT), exit);
+      ir_cmp(IR_GT, fargs[0], ir_consti(UCHAR_MAX, IR_LUAINT), exit);
+      args[2] = fargs[0];
+      syncregisters(J);
+      ret = ir_call(IR_INT, flvm_strchar, 3, args);
+      break;
+    }
+    case FLB_SELECT:
+    case FLB_SELECTCOUNT: {
+      compileselect(J, ti, fargs[0]);
+      return;
+    }
+    default: {
+      syncregisters(J);
+      ret = ir_call(IR_INT, flvm_callc, 2, args);
+      break;
+    }
+  }
+  /* the stack moved, the helper already set the resume point */
+  ir_cmp(IR_NE, ret, ir_consti(FL_SUCCESS, IR_INT), J->innerexit);
+  invalidateresults(J, ti, a, GETARG_C(i) - 1);
+}
+
+/* Increment the index of the trace loop, with integer or float values. The
+ * body can't change the limit and the step, so they are loaded once at the
+ * trace entry. The loop continues only if the index didn't pass the limit,
+ * which is false when any value is NaN (as in lvm.c). */
+static void compileforloop(JitState *J, struct TraceInstr *ti) {
+  int a = GETARG_A(ti->original);
+  int stepgt0 = ti->u.forloop.stepgt0;
+  int tag;
+  IRValue idx, newidx;
+  IRName body;
+  idx = gettvalue(J, a, &tag);
+  if (!J->insideloop) {
+    IRValue zero = (tag == LUA_TNUMFLT) ? ir_constf(0) :
+                                          ir_consti(0, IR_LUAINT);
+    J->forlimit = gettvalue(J, a + 1, NULL);
+    J->forstep = gettvalue(J, a + 2, NULL);
+    /* the comparison depends on the step sign */
+    ir_cmp(stepgt0 ? IR_LE : IR_GT, J->forstep, zero, J->earlyexit);
+  }
+  newidx = ir_binop(IR_ADD, idx, J->forstep);
+  body = ir_addbblock();
+  if (stepgt0)
+    ir_cmp(IR_LE, newidx, J->forlimit, body);
+  else
+    ir_cmp(IR_LE, J->forlimit, newidx, body);
+  ir_jmp(addexit(J, FL_SUCCESS, NULL));
+  ir_setbblock(body);
+  if (J->insideloop)
+    J->loopend = body;
+  else
+    J->preloop = body;
+  setregister(J, a, newidx, tag); /* internal index */
+  setregister(J, a + 3, newidx, tag); /* external index */
+}
+
+/* Index a table or a string with a constant string key. The lookup, with the
+ * __index chain, is a single runtime call and the result tag is guarded. */
+static void compileindex(JitState *J, struct TraceInstr *ti) {
+  Instruction i = ti->original;
+  int a = GETARG_A(i);
+  int restag = ti->u.index.tag;
+  int tag;
+  IRValue obj, res, args[4];
+  IRName exit = addexit(J, FL_SIDE_EXIT, J->currpc);
+  obj = gettvalue(J, GETARG_B(i), &tag);
+  args[0] = J->lstate;
+  args[1] = obj;
+  args[2] = ir_consti(tag, IR_INT);
+  args[3] = getconst(J, INDEXK(GETARG_C(i)), NULL);
+  res = ir_call(IR_PTR, flvm_index, 4, args);
+  ir_cmp(IR_EQ, res, ir_constp(NULL), exit);
+  guardtag(J, IR_NE, loadtag(J, res, 0), restag, exit);
+  if (GET_OPCODE(i) == OP_SELF)
+    setregister(J, a + 1, obj, tag);
+  setregister(J, a, loadvalue(J, res, 0, restag), restag);
+}
+
+/* Create a table with a runtime call. */
+static void compilenewtable(JitState *J, struct TraceInstr *ti) {
+  IRValue args[2], t;
+  syncregisters(J);
+  args[0] = J->lstate;
+  args[1] = ir_constp((void *)ti->instr);
+  t = ir_call(IR_PTR, flvm_newtable, 2, args);
+  /* the stack moved, the helper already set the resume point */
+  ir_cmp(IR_EQ, t, ir_constp(NULL), J->innerexit);
+  setregister(J, GETARG_A(ti->original), t, ctb(LUA_TTABLE));
+}
+
+/* Store the constructor values directly in the array part. The trace leaves
+ * if the array must grow. */
+static void compilesetlist(JitState *J, struct TraceInstr *ti) {
+  Instruction i = ti->original;
+  int a = GETARG_A(i);
+  int n = GETARG_B(i);
+  int first = (GETARG_C(i) - 1) * LFIELDS_PER_FLUSH;
+  int barrier = 0;
+  IRValue t, size, array;
+  int r;
+  t = gettvalue(J, a, NULL);
+  size = ir_load(IR_INT, t, offsetof(Table, sizearray));
+  ir_cmp(IR_LT, size, ir_consti(first + n, IR_INT),
+         addexit(J, FL_SIDE_EXIT, J->currpc));
+  array = ir_load(IR_PTR, t, offsetof(Table, array));
+  for (r = 1; r <= n; ++r) {
+    int tag;
+    IRValue v = gettvalue(J, a + r, &tag);
+    storevalue(J, array, sizeof(TValue) * (first + r - 1), v, tag);
+    if (tag & BIT_ISCOLLECTABLE) barrier = 1;
+  }
+  if (barrier) {
+    IRValue args[2];
+    args[0] = J->lstate;
+    args[1] = t;
+    ir_call(IR_VOID, flvm_barrierback, 2, args);
+  }
+}
+
+/* Walk the array part with an ipairs iterator. The results are computed
+ * inline, so they don't need to be reloaded. */
+static void compileipairs(JitState *J, struct TraceInstr *ti, IRValue t,
+                          IRValue ctl) {
+  int a = GETARG_A(ti->original);
+  int nresults = GETARG_C(ti->original);
+  int valuetag = ti->u.call.valuetag;
+  IRName exit = addexit(J, FL_SIDE_EXIT, J->currpc);
+  IRValue n, mt, size, array, addr, tag;
+  int r;
+  mt = ir_load(IR_PTR, t, offsetof(Table, metatable));
+  ir_cmp(IR_NE, mt, ir_constp(NULL), exit);
+  n = ir_binop(IR_ADD, ctl, ir_consti(1, IR_LUAINT));
+  size = ir_cast(ir_load(IR_INT, t, offsetof(Table, sizearray)), IR_LUAINT);
+  ir_cmp(IR_LT, n, ir_consti(1, IR_LUAINT), exit);
+  ir_cmp(IR_GT, n, size, exit);
+  /* &t->array[n - 1] */
+  array = ir_cast(ir_load(IR_PTR, t, offsetof(Table, array)), IR_LONG);
+  addr = ir_binop(IR_MUL, ir_cast(ctl, IR_LONG),
+                  ir_consti(sizeof(TValue), IR_LONG));
+  addr = ir_cast(ir_binop(IR_ADD, array, addr), IR_PTR);
+  tag = loadtag(J, addr, 0);
+  guardtag(J, IR_EQ, tag, LUA_TNIL, addexit(J, FL_SUCCESS, NULL));
+  guardtag(J, IR_NE, tag, valuetag, exit);
+  setregister(J, a + 3, n, LUA_TNUMINT);
+  if (nresults >= 2)
+    setregister(J, a + 4, loadvalue(J, addr, 0, valuetag), valuetag);
+  for (r = 2; r < nresults; ++r)
+    setregister(J, a + 3 + r, ir_consti(0, IR_INT), LUA_TNIL);
+}
+
+/* Walk the table with the next iterator. The position of the traversal is
+ * kept in a trace local cursor, so the key isn't searched at each step. */
+static void compilenext(JitState *J, struct TraceInstr *ti, IRValue t) {
+  int a = GETARG_A(ti->original);
+  int nresults = GETARG_C(ti->original);
+  IRValue args[5];
+  args[0] = J->lstate;
+  args[1] = t;
+  args[2] = ir_consti(a, IR_INT);
+  if (ir_isnullvalue(J->cursor)) {
+    /* find the control variable in the first iteration */
+    int tag;
+    IRValue ctl = gettvalue(J, a + 2, &tag);
+    storeregister(J, a + 2, ctl, tag);
+    J->cursor = ir_call(IR_LUAINT, flvm_tablecursor, 3, args);
+  }
+  args[2] = J->cursor;
+  args[3] = ir_consti(a, IR_INT);
+  args[4] = ir_consti(nresults, IR_INT);
+  J->cursor = ir_call(IR_LUAINT, flvm_tablenext, 5, args);
+  ir_cmp(IR_LT, J->cursor, ir_consti(0, IR_LUAINT),
+         addexit(J, FL_SUCCESS, NULL));
+  invalidateresults(J, ti, a + 3, nresults);
+}
+
+/* Call the iterator of a generic for. */
+static void compiletforcall(JitState *J, struct TraceInstr *ti) {
+  Instruction i = ti->original;
+  int a = GETARG_A(i);
+  int builtin = ti->u.call.builtin;
+  IRValue func, t, ctl, ret, args[4];
+  func = gettvalue(J, a, NULL);
+  t = gettvalue(J, a + 1, NULL);
+  ctl = gettvalue(J, a + 2, NULL);
+  if (builtin != FLB_NONE) {
+    lua_CFunction f = (builtin == FLB_IPAIRS) ? flbase_ipairsaux : flbase_next;
+    IRInt fi = cast(IRInt, cast(size_t, f));
+    ir_cmp(IR_NE, ir_cast(func, IR_LONG), ir_consti(fi, IR_LONG),
+           addexit(J, FL_SIDE_EXIT, J->currpc));
+  }
+  switch (builtin) {
+    case FLB_IPAIRS:
+      compileipairs(J, ti, t, ctl);
+      return;
+    case FLB_NEXT:
+      compilenext(J, ti, t);
+      return;
+    default:
+      break;
+  }
+  syncregisters(J);
+  args[0] = J->lstate;
+  args[1] = ir_constp((void *)ti->instr);
+  args[2] = ir_consti(a, IR_INT);
+  args[3] = ir_consti(GETARG_C(i), IR_INT);
+  ret = ir_call(IR_INT, flvm_tforcall, 4, args);
+  /* the stack moved, the helper already set the resume point */
+  ir_cmp(IR_NE, ret, ir_consti(FL_SUCCESS, IR_INT), J->innerexit);
+  invalidateresults(J, ti, a + 3, GETARG_C(i));
 }
 
 /*
  * Compiles a single bytecode in the trace.
  */
 static void compilebytecode(JitState *J, struct TraceInstr *ti) {
-  Instruction i = *ti->instr;
+  Instruction i = ti->original;
   int op = GET_OPCODE(i);
+  J->currpc = ti->instr;
   switch (op) {
     case OP_MOVE: {
       int tag;
@@ -278,7 +880,9 @@ static void compilebytecode(JitState *J, struct TraceInstr *ti) {
       setregister(J, GETARG_A(i), k, tag);
       break;
     }
-    case OP_ADD: {
+    case OP_ADD:
+    case OP_SUB:
+    case OP_MUL: {
       int btag, ctag, resulttag;
       IRValue rb = gettvalue(J, GETARG_B(i), &btag);
       IRValue rc = gettvalue(J, GETARG_C(i), &ctag);
@@ -296,22 +900,93 @@ static void compilebytecode(JitState *J, struct TraceInstr *ti) {
       setregister(J, GETARG_A(i), resultvalue, resulttag);
       break;
     }
-    case OP_FORLOOP: {
+    case OP_BAND:
+    case OP_BOR:
+    case OP_BXOR: {
+      IRValue rb = gettvalue(J, GETARG_B(i), NULL);
+      IRValue rc = gettvalue(J, GETARG_C(i), NULL);
+      setregister(J, GETARG_A(i), ir_binop(convertbinop(op), rb, rc),
+                  LUA_TNUMINT);
+      break;
+    }
+    case OP_SHL:
+    case OP_SHR: {
+      compileshift(J, ti);
+      break;
+    }
+    case OP_BNOT: {
+      IRValue rb = gettvalue(J, GETARG_B(i), NULL);
+      setregister(J, GETARG_A(i), ir_binop(IR_BXOR, rb,
+                  ir_consti(-1, IR_LUAINT)), LUA_TNUMINT);
+      break;
+    }
+    case OP_LEN: {
+      compilelen(J, GETARG_A(i), GETARG_B(i));
+      break;
+    }
+    case OP_CONCAT: {
+      compileconcat(J, ti);
+      break;
+    }
+    case OP_CALL: {
+      compileccall(J, ti);
+      break;
+    }
+    case OP_VARARG: {
+      compilevararg(J, ti);
+      break;
+    }
+    case OP_GETTABLE:
+    case OP_SELF: {
+      compileindex(J, ti);
+      break;
+    }
+    case OP_NEWTABLE: {
+      compilenewtable(J, ti);
+      break;
+    }
+    case OP_SETLIST: {
+      compilesetlist(J, ti);
+      break;
+    }
+    case OP_JMP: {
+      break;
+    }
+    case OP_TFORCALL: {
+      compiletforcall(J, ti);
+      break;
+    }
+    case OP_TFORLOOP: {
       int a = GETARG_A(i);
       int tag;
-      IRValue idx = gettvalue(J, a, &tag);
-      IRValue limit = getforloopvalue(J, a + 1, ti->instr);
-      IRValue step =  getforloopvalue(J, a + 2, ti->instr);
-      IRValue newidx;
-      IRName loopexit = addexit(J, 0);
-      if (!J->insideloop) {
-        enum IRCmpOp cmp = ti->u.forloop.steplt0 ? IR_GE : IR_LT;
-        ir_cmp(cmp, step, ir_consti(0, IR_LUAINT), J->earlyexit);
+      IRValue key;
+      if (ti->instr != J->tr->start) {
+        compilecall(J, ti);
+        break;
       }
-      newidx = ir_binop(IR_ADD, idx, step);
-      ir_cmp(ti->u.forloop.steplt0 ? IR_LT : IR_GT, newidx, limit, loopexit);
-      setregister(J, a, newidx, tag); /* internal index */
-      setregister(J, a + 3, newidx, tag); /* external index */
+      if (ir_isnullvalue(J->r[a + 1].current)) {
+        /* the iterator returned nil before the trace started */
+        IRValue keytag = loadtag(J, J->base, (a + 1) * sizeof(TValue));
+        guardtag(J, IR_EQ, keytag, LUA_TNIL, addexit(J, FL_SUCCESS, NULL));
+      }
+      key = gettvalue(J, a + 1, &tag);
+      setregister(J, a, key, tag); /* control variable */
+      break;
+    }
+    case OP_FORPREP: {
+      int a = GETARG_A(i);
+      int tag;
+      IRValue init = gettvalue(J, a, &tag);
+      IRValue step = gettvalue(J, a + 2, NULL);
+      setregister(J, a, ir_binop(IR_SUB, init, step), tag);
+      break;
+    }
+    case OP_FORLOOP: {
+      if (ti->instr != J->tr->start) {
+        compilecall(J, ti);
+        break;
+      }
+      compileforloop(J, ti);
       break;
     }
     default:
@@ -327,14 +1002,18 @@ static void initblocks(JitState *J) {
   J->loopstart = J->loopend = ir_addbblock();
   J->earlyexit = ir_addbblock();
   ir_setbblock(J->earlyexit);
-  ir_return(ir_consti(1, IR_LONG));
+  ir_return(ir_consti(FL_EARLY_EXIT, IR_LONG));
+  J->innerexit = ir_addbblock();
+  ir_setbblock(J->innerexit);
+  ir_return(ir_consti(FL_SIDE_EXIT, IR_LONG));
 }
 
 static void compilepreloop(JitState *J) {
   ir_setbblock(J->preloop);
-  J->lstate = ir_constp(J->L);
+  J->lstate = ir_getarg(IR_PTR, 0);
   J->base = ir_getarg(IR_PTR, 1);
   flt_rtvec_foreach(&J->tr->instrs, ti, compilebytecode(J, ti));
+  reloadsetregisters(J);
 }
 
 static void compileloop(JitState *J) {
@@ -342,6 +1021,30 @@ static void compileloop(JitState *J) {
   ir_setbblock(J->loopstart);
   createphivalues(J);
   flt_rtvec_foreach(&J->tr->instrs, ti, compilebytecode(J, ti));
+  reloadsetregisters(J);
+}
+
+/* Run a GC step at the loop back-edge when the collector has debt (see
+ * luaC_checkGC), so long traces keep the memory bounded. The registers are
+ * stored before the step because the GC only traverses the stack. */
+static void compilesafepoint(JitState *J) {
+  IRName gcstep = ir_addbblock();
+  IRName join = ir_addbblock();
+  IRValue g, debt, args[2], ret;
+  ir_setbblock(J->loopend);
+  g = ir_load(IR_PTR, J->lstate, offsetof(lua_State, l_G));
+  debt = ir_load(IR_LONG, g, offsetof(global_State, GCdebt));
+  ir_cmp(IR_GT, debt, ir_consti(0, IR_LONG), gcstep);
+  ir_jmp(join);
+  ir_setbblock(gcstep);
+  syncregisters(J);
+  args[0] = J->lstate;
+  args[1] = ir_constp((void *)J->tr->start);
+  ret = ir_call(IR_INT, flvm_checkgc, 2, args);
+  /* the stack moved, the helper already set the resume point */
+  ir_cmp(IR_NE, ret, ir_consti(FL_SUCCESS, IR_INT), J->innerexit);
+  ir_jmp(join);
+  J->loopend = join;
 }
 
 /* Add the missing jumps in the basic blocks. */
@@ -354,20 +1057,23 @@ static void addjmps(JitState *J) {
   ir_jmp(J->loopstart);
 }
 
-void fljit_compile(TraceRecording *tr) {
+int fljit_compile(TraceRecording *tr) {
   JitState *J;
-  if (!tr->completeloop) return;
+  int failed;
+  if (!tr->completeloop) return 1;
   fllogln("starting jit compilation (%p)", tr->p);
   J = createjitstate(tr->L, tr);
   initblocks(J);
   compilepreloop(J);
   compileloop(J);
+  compilesafepoint(J);
   addjmps(J);
   linkphivalues(J);
   exvec_foreach(&J->exits, e, closeexit(J, e));
   ir_print();
   fllogln("ended jit compilation");
-  flasm_compile(tr->L, tr->p, (Instruction*)tr->start, &J->irfunc);
+  failed = flasm_compile(tr->L, tr->p, (Instruction*)tr->start, &J->irfunc);
   destroyjitstate(J);
+  return failed;
 }
 
@@ -34,8 +34,8 @@
 #include "fl_defs.h"
 #include "fl_trace.h"
 
-/* Compiles the trace recording. */
-void fljit_compile(TraceRecording *tr);
+/* Compiles the trace recording. Return 0 if the compilation succeeded. */
+int fljit_compile(TraceRecording *tr);
 
 #endif
 
@@ -0,0 +1,84 @@
+/*
+ * The MIT License (MIT)
+ * 
+ * Copyright (c) 2016 Gabriel de Quadros Ligneul
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * Dispatch tables of luaV_execute for compilers with computed gotos. This
+ * file is included inside luaV_execute, since the tables hold the addresses
+ * of its labels.
+ *
+ * The interpreter has two dispatch loops. The plain one jumps directly from
+ * each opcode to the next one, without checking the recording state. While a
+ * trace is recorded, every opcode goes first to the 'l_record' label, which
+ * records the instruction before executing it. The table is selected by
+ * updatedisp() when the recording state may have changed: at the frame
+ * entry, after the protected calls and after the FastLua opcodes.
+ *
+ * Label addresses and 'goto *' are GNU extensions, so lvm.c compiles
+ * luaV_execute with -Wpedantic disabled when the tables are used.
+ */
+
+#undef vmrecord
+#define vmrecord()	((void)0)
+
+#undef vmdispatch
+#undef vmcase
+#undef vmbreak
+
+#define vmdispatch(o)	goto *disp[o];
+#define vmcase(l)	L_##l:
+#define vmbreak		vmfetch(); vmdispatch(GET_OPCODE(i));
+
+#undef updatedisp
+#define updatedisp()	(disp = flrec_isrecording(L) ? rectab : disptab)
+
+/* every opcode, in order; the tables are built from this list */
+#define JUMPTAB_OPCODES(_) \
+  _(OP_MOVE) _(OP_LOADK) _(OP_LOADKX) _(OP_LOADBOOL) _(OP_LOADNIL) \
+  _(OP_GETUPVAL) _(OP_GETTABUP) _(OP_GETTABLE) _(OP_SETTABUP) \
+  _(OP_SETUPVAL) _(OP_SETTABLE) _(OP_NEWTABLE) _(OP_SELF) _(OP_ADD) \
+  _(OP_SUB) _(OP_MUL) _(OP_MOD) _(OP_POW) _(OP_DIV) _(OP_IDIV) _(OP_BAND) \
+  _(OP_BOR) _(OP_BXOR) _(OP_SHL) _(OP_SHR) _(OP_UNM) _(OP_BNOT) _(OP_NOT) \
+  _(OP_LEN) _(OP_CONCAT) _(OP_JMP) _(OP_EQ) _(OP_LT) _(OP_LE) _(OP_TEST) \
+  _(OP_TESTSET) _(OP_CALL) _(OP_TAILCALL) _(OP_RETURN) _(OP_FORLOOP) \
+  _(OP_FORPREP) _(OP_TFORCALL) _(OP_TFORLOOP) _(OP_SETLIST) _(OP_CLOSURE) \
+  _(OP_VARARG) _(OP_EXTRAARG) _(OP_FLVM) _(OP_ADDII) _(OP_ADDFF) _(OP_LTII) \
+  _(OP_LTFF) _(OP_GETARRAY)
+
+#define JUMPTAB_LABEL(op)	&&L_##op,
+#define JUMPTAB_RECORD(op)	&&l_record,
+
+static const void *const disptab[NUM_OPCODES] = {
+  JUMPTAB_OPCODES(JUMPTAB_LABEL)
+};
+
+static const void *const rectab[NUM_OPCODES] = {
+  JUMPTAB_OPCODES(JUMPTAB_RECORD)
+};
+
+#undef JUMPTAB_OPCODES
+#undef JUMPTAB_LABEL
+#undef JUMPTAB_RECORD
+
+const void *const *disp = disptab;
+
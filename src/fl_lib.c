@@ -28,7 +28,9 @@
 #include "lua.h"
 #include "lauxlib.h"
 #include "lualib.h"
+#include "lstate.h"
 
+#include "fl_asm.h"
 #include "fl_logger.h"
 
 /*
@@ -50,8 +52,62 @@ static int logger(lua_State *L) {
   return 0;
 }
 
+/*
+ * Obtain the memory used by the compiled traces, in Kbytes.
+ */
+static int memory(lua_State *L) {
+  lua_pushnumber(L, (lua_Number)G(L)->fl.jitmem / 1024);
+  return 1;
+}
+
+/*
+ * Obtain the memory budget of the compiled traces and optionally change it.
+ * The least recently executed traces are evicted when it is exceeded.
+ * Parameters:
+ *  kbytes : number     (optional) new budget, in Kbytes
+ */
+static int limit(lua_State *L) {
+  size_t old = G(L)->fl.jitlimit;
+  if (!lua_isnoneornil(L, 1)) {
+    lua_Integer kbytes = luaL_checkinteger(L, 1);
+    luaL_argcheck(L, kbytes >= 0, 1, "non-negative budget expected");
+    flasm_setlimit(L, (size_t)kbytes * 1024);
+  }
+  lua_pushinteger(L, (lua_Integer)(old / 1024));
+  return 1;
+}
+
+/*
+ * Obtain the statistics of the pools of the default allocator (see
+ * luaL_allocstats), or nil if the state does not use them.
+ * Returns a table with the fields 'pooled', 'large' and 'pagesize' (bytes),
+ * 'pages' and 'released'.
+ */
+static int allocstats(lua_State *L) {
+  luaL_AllocStats st;
+  if (!luaL_allocstats(L, &st)) {
+    lua_pushnil(L);
+    return 1;
+  }
+  lua_createtable(L, 0, 5);
+  lua_pushinteger(L, (lua_Integer)st.pooled);
+  lua_setfield(L, -2, "pooled");
+  lua_pushinteger(L, (lua_Integer)st.large);
+  lua_setfield(L, -2, "large");
+  lua_pushinteger(L, (lua_Integer)st.pages);
+  lua_setfield(L, -2, "pages");
+  lua_pushinteger(L, (lua_Integer)st.pagesize);
+  lua_setfield(L, -2, "pagesize");
+  lua_pushinteger(L, (lua_Integer)st.released);
+  lua_setfield(L, -2, "released");
+  return 1;
+}
+
 static const luaL_Reg jit_funcs[] = {
   {"logger", logger},
+  {"memory", memory},
+  {"limit", limit},
+  {"allocstats", allocstats},
   {NULL, NULL}
 };
 
@@ -28,10 +28,12 @@
 #include "lobject.h"
 #include "lopcodes.h"
 #include "lstate.h"
+#include "lvm.h"
 
 #include "fl_jitc.h"
 #include "fl_logger.h"
 #include "fl_rec.h"
+#include "fl_vm.h"
 
 #define tracerec(L) (L->fl.trace)
 
@@ -48,7 +50,7 @@
 static void readregister(TraceRecording *tr, int regpos, int tag) {
   struct TraceRegister *treg = tr->regs + regpos;
   /* check if the register must be loaded from the stack */
-  if (!treg->set) {
+  if (!treg->set && !treg->loaded) {
     treg->loadedtag = treg->tag = tag;
     treg->loaded = 1;
   }
@@ -74,12 +76,113 @@ static int computebintoptag(int lhs, int rhs) {
     return LUA_TNUMFLT;
 }
 
-/* Verify if the forloop step is less then 0. */
-static int isforloopsteplt0(TValue *ra) {
+/* Verify if the forloop step is greater than 0, which selects the limit
+ * comparison in the same way of lvm.c. */
+static int isforloopstepgt0(TValue *ra) {
   if (ttisinteger(ra))
-    return ivalue(ra + 2) < 0;
+    return 0 < ivalue(ra + 2);
   else
-    return fltvalue(ra + 2) < 0;
+    return luai_numlt(0, fltvalue(ra + 2));
+}
+
+/* Verify if the forloop will jump back to the loop body. */
+static int forloopcontinues(TValue *ra) {
+  if (ttisinteger(ra)) {
+    lua_Integer step = ivalue(ra + 2);
+    lua_Integer idx = intop(+, ivalue(ra), step);
+    lua_Integer limit = ivalue(ra + 1);
+    return (0 < step) ? (idx <= limit) : (limit <= idx);
+  }
+  else {
+    lua_Number step = fltvalue(ra + 2);
+    lua_Number idx = fltvalue(ra) + step;
+    lua_Number limit = fltvalue(ra + 1);
+    return luai_numlt(0, step) ? luai_numle(idx, limit)
+                               : luai_numle(limit, idx);
+  }
+}
+
+/* Check if the arguments of the call have the given types ('s' for string,
+ * 'i' for integer). */
+static int checkargs(TValue *ra, int nargs, const char *types) {
+  int n;
+  for (n = 0; n < nargs; ++n) {
+    TValue *arg = ra + 1 + n;
+    if (types[n] == '\0' ||
+        (types[n] == 's' && !ttisstring(arg)) ||
+        (types[n] == 'i' && !ttisinteger(arg)))
+      return 0;
+  }
+  return 1;
+}
+
+/* Verify if the call has a fast path. */
+static int findbuiltin(TValue *ra, int nargs, int nresults) {
+  lua_CFunction f;
+  if (!ttislcf(ra) || nresults != 1) return FLB_NONE;
+  f = fvalue(ra);
+  if (f == flstr_byte && (nargs == 1 || nargs == 2) &&
+      checkargs(ra, nargs, "si"))
+    return FLB_STRBYTE;
+  if (f == flstr_sub && (nargs == 2 || nargs == 3) &&
+      checkargs(ra, nargs, "sii"))
+    return FLB_STRSUB;
+  if (f == flstr_char && nargs == 1 && checkargs(ra, nargs, "i"))
+    return FLB_STRCHAR;
+  return FLB_NONE;
+}
+
+/* Number of varargs of the running function. */
+static int countvarargs(CallInfo *ci) {
+  int n = cast_int(ci->u.l.base - ci->func) - getproto(ci->func)->numparams - 1;
+  return n < 0 ? 0 : n;
+}
+
+/* Verify if the call is select('#', ...) or select(i, ...) right after the
+ * open OP_VARARG, so the varargs can be read from the stack. The '#' must be
+ * loaded by the previous instruction. */
+static int findselect(const Instruction *iptr, CallInfo *ci, TValue *ra,
+                      int nargs, int nresults, struct TraceInstr *ti) {
+  int nvarargs = countvarargs(ci);
+  const Instruction *prev = iptr - 2;
+  if (!ttislcf(ra) || fvalue(ra) != flbase_select || nargs != 1 ||
+      nresults < 1)
+    return FLB_NONE;
+  ti->u.call.nvarargs = nvarargs;
+  if (GET_OPCODE(*prev) == OP_LOADK && GETARG_A(*prev) == GETARG_A(*iptr) + 1 &&
+      ttisstring(ra + 1) && tsslen(tsvalue(ra + 1)) == 1 &&
+      *svalue(ra + 1) == '#')
+    return FLB_SELECTCOUNT;
+  if (ttisinteger(ra + 1)) {
+    lua_Integer n = ivalue(ra + 1);
+    if (n > 0 || (n < 0 && nvarargs + n >= 0)) {
+      ti->u.call.index = n <= nvarargs ? cast_int(n) : nvarargs + 1;
+      return FLB_SELECT;
+    }
+  }
+  return FLB_NONE;
+}
+
+/* Verify if the generic for of the trace loop has a fast path. The ipairs
+ * value is read ahead, so its tag is known before the call. */
+static int finditerator(TraceRecording *tr, const Instruction *iptr,
+                        TValue *ra, lu_byte *valuetag) {
+  lua_CFunction f;
+  Table *t;
+  if (iptr + 1 != tr->start || !ttislcf(ra) || !ttistable(ra + 1))
+    return FLB_NONE;
+  f = fvalue(ra);
+  t = hvalue(ra + 1);
+  if (f == flbase_ipairsaux && ttisinteger(ra + 2) && t->metatable == NULL) {
+    lua_Integer n = intop(+, ivalue(ra + 2), 1);
+    if (l_castS2U(n) - 1u < t->sizearray && !ttisnil(&t->array[n - 1])) {
+      *valuetag = rttype(&t->array[n - 1]);
+      return FLB_IPAIRS;
+    }
+  }
+  if (f == flbase_next)
+    return FLB_NEXT;
+  return FLB_NONE;
 }
 
 /* Produce the runtime information about the instruction.
@@ -91,7 +194,9 @@ static int recordinstruction(TraceRecording *tr, CallInfo *ci,
   TValue *base = ci->u.l.base;
   TValue *k = getproto(ci->func)->k;
   int failed = 0;
+  i = fli_getoriginal(tr->p, (Instruction *)iptr);
   ti.instr = iptr;
+  ti.original = i;
   switch (GET_OPCODE(i)) {
     case OP_MOVE: {
       int tag = rttype(RB(i));
@@ -116,9 +221,206 @@ static int recordinstruction(TraceRecording *tr, CallInfo *ci,
       failed = !(ttisnumber(rkb) && ttisnumber(rkc));
       break;
     }
-    case OP_FORLOOP: {
+    case OP_BAND:
+    case OP_BOR:
+    case OP_BXOR:
+    case OP_SHL:
+    case OP_SHR: {
+      TValue *rkb = RKB(i), *rkc = RKC(i);
+      readrk(tr, GETARG_B(i), rttype(rkb));
+      readrk(tr, GETARG_C(i), rttype(rkc));
+      setregister(tr, GETARG_A(i), LUA_TNUMINT);
+      /* floats and strings need a conversion */
+      failed = !(ttisinteger(rkb) && ttisinteger(rkc));
+      break;
+    }
+    case OP_BNOT: {
+      TValue *rb = RB(i);
+      readregister(tr, GETARG_B(i), rttype(rb));
+      setregister(tr, GETARG_A(i), LUA_TNUMINT);
+      failed = !ttisinteger(rb);
+      break;
+    }
+    case OP_LEN: {
+      TValue *rb = RB(i);
+      readregister(tr, GETARG_B(i), rttype(rb));
+      setregister(tr, GETARG_A(i), LUA_TNUMINT);
+      /* tables with metatables may have the __len metamethod */
+      failed = !(ttisstring(rb) ||
+                 (ttistable(rb) && hvalue(rb)->metatable == NULL));
+      break;
+    }
+    case OP_CONCAT: {
+      int r;
+      for (r = GETARG_B(i); r <= GETARG_C(i); ++r) {
+        TValue *o = base + r;
+        readregister(tr, r, rttype(o));
+        if (!(ttisstring(o) || ttisnumber(o)))
+          failed = 1;
+      }
+      /* the tag is only known after the runtime call */
+      setregister(tr, GETARG_A(i), ctb(LUA_TSHRSTR));
+      ti.u.call.tags = flt_tagvec_size(&tr->calltags);
+      tr->aftercall = 1;
+      break;
+    }
+    case OP_CALL: {
+      TValue *ra = RA(i);
+      int nargs = GETARG_B(i) - 1;
+      int nresults = GETARG_C(i) - 1;
+      int r;
+      /* open arguments only come from the varargs */
+      if (nargs < 0 && GET_OPCODE(*(iptr - 1)) == OP_VARARG &&
+          GETARG_B(*(iptr - 1)) == 0)
+        nargs = GETARG_A(*(iptr - 1)) - GETARG_A(i) - 1;
+      /* only C functions with fixed results */
+      if (!(ttislcf(ra) || ttisCclosure(ra)) || nargs < 0 || nresults < 0) {
+        fllogln("recordinstruction: unhandled call");
+        failed = 1;
+        break;
+      }
+      for (r = 0; r <= nargs; ++r)
+        readregister(tr, GETARG_A(i) + r, rttype(ra + r));
+      /* the tags are only known after the call */
+      for (r = 0; r < nresults; ++r)
+        setregister(tr, GETARG_A(i) + r, LUA_TNIL);
+      if (GETARG_B(i) == 0) {
+        ti.u.call.builtin = findselect(iptr, ci, ra, nargs, nresults, &ti);
+        /* the varargs aren't copied to the stack by the select fast path */
+        if (ti.u.call.builtin != FLB_NONE)
+          flt_rtvec_getref(&tr->instrs, flt_rtvec_size(&tr->instrs) - 1)
+              ->u.call.builtin = ti.u.call.builtin;
+      }
+      else
+        ti.u.call.builtin = findbuiltin(ra, nargs, nresults);
+      ti.u.call.tags = flt_tagvec_size(&tr->calltags);
+      tr->aftercall = 1;
+      break;
+    }
+    case OP_GETTABLE:
+    case OP_SELF: {
+      TValue *rb = RB(i), *rkc = RKC(i);
+      const TValue *res = NULL;
+      readregister(tr, GETARG_B(i), rttype(rb));
+      /* only constant string keys in tables and strings */
+      if (ISK(GETARG_C(i)) && ttisstring(rkc) &&
+          (ttistable(rb) || ttisstring(rb)))
+        res = flvm_index(tr->L, gcvalue(rb), rttype(rb), tsvalue(rkc));
+      if (!res) {
+        fllogln("recordinstruction: unhandled index");
+        failed = 1;
+        break;
+      }
+      ti.u.index.tag = rttype(res);
+      if (GET_OPCODE(i) == OP_SELF)
+        setregister(tr, GETARG_A(i) + 1, rttype(rb));
+      setregister(tr, GETARG_A(i), rttype(res));
+      break;
+    }
+    case OP_VARARG: {
+      int n = GETARG_B(i) - 1;
+      int r;
+      ti.u.call.nvarargs = countvarargs(ci);
+      ti.u.call.builtin = FLB_NONE;
+      if (n < 0)  /* open results, consumed by the next call */
+        break;
+      /* the tags are only known after the copy */
+      for (r = 0; r < n; ++r)
+        setregister(tr, GETARG_A(i) + r, LUA_TNIL);
+      ti.u.call.tags = flt_tagvec_size(&tr->calltags);
+      tr->aftercall = 1;
+      break;
+    }
+    case OP_NEWTABLE: {
+      setregister(tr, GETARG_A(i), ctb(LUA_TTABLE));
+      break;
+    }
+    case OP_SETLIST: {
+      TValue *ra = RA(i);
+      int n = GETARG_B(i);
+      int r;
+      /* open calls and the extra argument aren't supported */
+      if (n == 0 || GETARG_C(i) == 0 || !ttistable(ra)) {
+        fllogln("recordinstruction: unhandled setlist");
+        failed = 1;
+        break;
+      }
+      for (r = 0; r <= n; ++r)
+        readregister(tr, GETARG_A(i) + r, rttype(ra + r));
+      break;
+    }
+    case OP_JMP: {
+      /* the trace follows the jump, but upvalues can't be closed */
+      failed = (GETARG_A(i) != 0);
+      break;
+    }
+    case OP_TFORCALL: {
+      TValue *ra = RA(i);
+      int a = GETARG_A(i);
+      int nresults = GETARG_C(i);
+      int r;
+      /* only C iterators */
+      if (!(ttislcf(ra) || ttisCclosure(ra))) {
+        fllogln("recordinstruction: unhandled iterator");
+        failed = 1;
+        break;
+      }
+      for (r = 0; r < 3; ++r)
+        readregister(tr, a + r, rttype(ra + r));
+      ti.u.call.builtin = finditerator(tr, iptr, ra, &ti.u.call.valuetag);
+      if (ti.u.call.builtin == FLB_IPAIRS) {
+        setregister(tr, a + 3, LUA_TNUMINT);
+        if (nresults >= 2)
+          setregister(tr, a + 4, ti.u.call.valuetag);
+        for (r = 2; r < nresults; ++r)
+          setregister(tr, a + 3 + r, LUA_TNIL);
+        break;
+      }
+      /* the tags are only known after the call */
+      for (r = 0; r < nresults; ++r)
+        setregister(tr, a + 3 + r, LUA_TNIL);
+      ti.u.call.tags = flt_tagvec_size(&tr->calltags);
+      tr->aftercall = 1;
+      break;
+    }
+    case OP_FORPREP: {
+      /* inner loop, the values must not need a conversion */
+      TValue *ra = RA(i);
+      readregister(tr, GETARG_A(i), rttype(ra));
+      readregister(tr, GETARG_A(i) + 1, rttype(ra + 1));
+      readregister(tr, GETARG_A(i) + 2, rttype(ra + 2));
+      setregister(tr, GETARG_A(i), rttype(ra));
+      failed = !((ttisinteger(ra) && ttisinteger(ra + 1) &&
+                  ttisinteger(ra + 2)) ||
+                 (ttisfloat(ra) && ttisfloat(ra + 1) && ttisfloat(ra + 2)));
+      break;
+    }
+    case OP_FORLOOP:
+    case OP_TFORLOOP: {
       int tag = rttype(RA(i));
-      ti.u.forloop.steplt0 = isforloopsteplt0(RA(i));
+      if (iptr != tr->start) {
+        /* inner loop, it must be compiled before the outer one */
+        if (fli_isexec(iptr)) {
+          ti.u.call.tags = flt_tagvec_size(&tr->calltags);
+          tr->aftercall = 1;
+        }
+        else {
+          fllogln("recordinstruction: inner loop not compiled");
+          tr->innerloop = iptr;
+          failed = 1;
+        }
+        break;
+      }
+      if (GET_OPCODE(i) == OP_TFORLOOP) {
+        /* the control variable receives the first result of the call */
+        tag = rttype(RA(i) + 1);
+        failed = ttisnil(RA(i) + 1);
+        readregister(tr, GETARG_A(i) + 1, tag);
+        setregister(tr, GETARG_A(i), tag);
+        break;
+      }
+      failed = !forloopcontinues(RA(i));
+      ti.u.forloop.stepgt0 = isforloopstepgt0(RA(i));
       readregister(tr, GETARG_A(i), tag);
       readregister(tr, GETARG_A(i) + 1, tag);
       readregister(tr, GETARG_A(i) + 2, tag);
@@ -127,7 +429,8 @@ static int recordinstruction(TraceRecording *tr, CallInfo *ci,
       break;
     }
     default:
-      fll_error("unhandled opcode");
+      fllogln("recordinstruction: unhandled opcode");
+      failed = 1;
       break;
   }
   if (!failed) flt_rtvec_push(&tr->instrs, ti);
@@ -137,8 +440,13 @@ static int recordinstruction(TraceRecording *tr, CallInfo *ci,
 void flrec_start(struct lua_State *L) {
   fll_assert(!flrec_isrecording(L), "flrec_start: already recording");
   fll_assert(!tracerec(L), "flrec_start: already have an trace record");
+  TraceRecording *tr;
   fllogln("flrec_start: start recording (%p)", getproto(L->ci->func));
-  tracerec(L) = flt_createtrace(L);
+  tr = tracerec(L) = flt_createtrace(L);
+  tr->p = getproto(L->ci->func);
+  tr->ci = L->ci;
+  tr->regs = luaM_newvector(L, tr->p->maxstacksize, struct TraceRegister);
+  memset(tr->regs, 0, tr->p->maxstacksize * sizeof(struct TraceRegister));
 }
 
 /* Stop the recording. */
@@ -146,7 +454,13 @@ static void stoprecording(struct lua_State *L, int failed) {
   fll_assert(flrec_isrecording(L), "stoprecording: not recording");
   fll_assert(tracerec(L), "stoprecording: trace record not found");
   fllogln("stoprecording: stop recording");
-  if (!failed) fljit_compile(tracerec(L));
+  if (!failed) failed = fljit_compile(tracerec(L));
+  if (failed && tracerec(L)->start) {
+    Proto *p = tracerec(L)->p;
+    Instruction *loop = (Instruction *)tracerec(L)->start;
+    Instruction original = fli_getoriginal(p, loop);
+    flvm_penalize(L, p, fli_getprof(loop, original));
+  }
   flt_destroytrace(tracerec(L));
   tracerec(L) = NULL;
 }
@@ -163,27 +477,83 @@ static int checkphivalues(TraceRecording *tr) {
   return 0;
 }
 
+/* Verify if the generic for jumps back to the loop body, the numeric one is
+ * checked by the trace. */
+static int loopcontinues(TraceRecording *tr, CallInfo *ci) {
+  Instruction i = fli_getoriginal(tr->p, (Instruction *)tr->start);
+  TValue *base = ci->u.l.base;
+  return GET_OPCODE(i) != OP_TFORLOOP || !ttisnil(RA(i) + 1);
+}
+
+/* The recording reached an inner loop that isn't compiled. The inner loop is
+ * recorded right now and the outer loop is recorded again at its next
+ * iteration. */
+static void switchtoinnerloop(struct lua_State *L, struct CallInfo *ci) {
+  TraceRecording *tr = tracerec(L);
+  Proto *p = tr->p;
+  Instruction *outer = (Instruction *)tr->start;
+  Instruction *inner = (Instruction *)tr->innerloop;
+  stoprecording(L, 1);
+  if (!fli_isfl(outer) && fli_isfl(fli_getprof(outer, *outer)))
+    fli_torec(p, outer);
+  if (!fli_isfl(inner) && fli_isfl(fli_getprof(inner, *inner))) {
+    flrec_start(L);
+    flrec_record_(L, ci);
+  }
+}
+
+/* Save the register tags after the execution of an inner trace or a runtime
+ * function. */
+static void savecalltags(TraceRecording *tr, CallInfo *ci) {
+  TValue *base = ci->u.l.base;
+  int i;
+  for (i = 0; i < tr->p->maxstacksize; ++i) {
+    struct TraceRegister *treg = tr->regs + i;
+    int tag = rttype(base + i);
+    flt_tagvec_push(&tr->calltags, tag);
+    if (treg->set || treg->loaded)
+      treg->tag = tag;
+  }
+  tr->aftercall = 0;
+}
+
 void flrec_record_(struct lua_State *L, struct CallInfo* ci) {
   TraceRecording *tr = tracerec(L);
   const Instruction *i = ci->u.l.savedpc;
+  if (tr->aftercall)
+    savecalltags(tr, ci);
+  if (flvm_hooked(L)) {
+    fllogln("recording failed: a count or line hook was set");
+    stoprecording(L, 1);
+    return;
+  }
+  if (ci != tr->ci || getproto(ci->func) != tr->p) {
+    /* code run by a finalizer, an iterator or a C function (which may call
+     * the recorded function again) inside a runtime call */
+    fllogln("recording failed: left the function");
+    stoprecording(L, 1);
+    return;
+  }
   if (tr->start != i) {
     fllogln("flrec_record_: %s", luaP_opnames[GET_OPCODE(*i)]);
-    if (tr->start == NULL) {
-      /* start the recording */
-      tr->p = getproto(ci->func);
-      tr->regs = luaM_newvector(L, tr->p->maxstacksize, struct TraceRegister);
-      memset(tr->regs, 0, tr->p->maxstacksize * sizeof(struct TraceRegister));
-      tr->start = i;
-    }
-    if (recordinstruction(tr, ci, i)) {
-      fllogln("recording failed");
+    if (tr->start == NULL)
+      tr->start = i; /* start the recording */
+    if (flt_rtvec_size(&tr->instrs) >= FL_JIT_MAXTRACELEN) {
+      fllogln("recording failed: trace too long");
       stoprecording(L, 1);
     }
+    else if (recordinstruction(tr, ci, i)) {
+      fllogln("recording failed");
+      if (tr->innerloop)
+        switchtoinnerloop(L, ci);
+      else
+        stoprecording(L, 1);
+    }
   }
   else {
     /* back to the loop start */
     tr->completeloop = 1;
-    stoprecording(L, checkphivalues(tr));
+    stoprecording(L, checkphivalues(tr) || !loopcontinues(tr, ci));
   }
 }
 
@@ -32,9 +32,13 @@ TraceRecording *flt_createtrace(struct lua_State *L) {
   TraceRecording *tr = luaM_new(L, TraceRecording);
   tr->L = L;
   tr->p = NULL;
+  tr->ci = NULL;
   tr->start = NULL;
   flt_rtvec_create(&tr->instrs, L);
   tr->regs = NULL;
+  flt_tagvec_create(&tr->calltags, L);
+  tr->aftercall = 0;
+  tr->innerloop = NULL;
   tr->completeloop = 0;
   return tr;
 }
@@ -42,6 +46,7 @@ TraceRecording *flt_createtrace(struct lua_State *L) {
 void flt_destroytrace(TraceRecording *tr) {
   if (tr->p) luaM_freearray(tr->L, tr->regs, tr->p->maxstacksize);
   flt_rtvec_destroy(&tr->instrs);
+  flt_tagvec_destroy(&tr->calltags);
   luaM_free(tr->L, tr);
 }
 
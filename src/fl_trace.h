@@ -37,8 +37,17 @@ struct lua_State;
 /* Runtime information for each instruction */
 struct TraceInstr {
   const Instruction *instr;     /* instruction */
+  Instruction original;         /* instruction before the FL conversion */
   union {                       /* specific fields for each opcode */
-    struct { lu_byte steplt0; } forloop;
+    struct { lu_byte stepgt0; } forloop;
+    struct { lu_byte tag; } index;
+    struct {
+      size_t tags;              /* register tags after the call */
+      lu_byte builtin;          /* C function with a fast path */
+      lu_byte valuetag;         /* tag of the ipairs value */
+      int nvarargs;             /* number of varargs */
+      int index;                /* select index (clamped) */
+    } call;
   } u;
 };
 
@@ -47,6 +56,9 @@ TSCC_DECL_VECTOR(TraceInstrVector, flt_rtvec_, struct TraceInstr)
 #define flt_rtvec_foreach(vec, val, cmd) \
     TSCC_VECTOR_FOREACH(flt_rtvec_, vec, struct TraceInstr, val, cmd)
 
+/* Register tags container */
+TSCC_DECL_VECTOR(TraceTagVector, flt_tagvec_, lu_byte)
+
 /* Runtime information about the registers */
 struct TraceRegister {
   lu_byte tag;                  /* register's tag */
@@ -60,9 +72,14 @@ struct TraceRegister {
 typedef struct TraceRecording {
   struct lua_State *L;          /* Lua state */
   struct Proto *p;              /* Lua function */
+  struct CallInfo *ci;          /* frame of the recorded function */
   const Instruction *start;     /* first instruction of the trace */
   TraceInstrVector instrs;      /* runtime info for each instruction */
   struct TraceRegister *regs;   /* runtime info for each register */
+  TraceTagVector calltags;      /* register tags after each call */
+  lu_byte aftercall;            /* an inner trace or a runtime function was
+                                   just executed */
+  const Instruction *innerloop; /* inner loop that isn't compiled */
   lu_byte completeloop;         /* tell if the trace is a full loop */
 } TraceRecording;
 
@@ -23,26 +23,323 @@
  */
 
 #include "lprefix.h"
+#include "ldo.h"
+#include "lgc.h"
 #include "lobject.h"
+#include "lopcodes.h"
 #include "lstate.h"
+#include "lstring.h"
+#include "ltable.h"
+#include "ltm.h"
 #include "lvm.h"
 
+#include "fl_asm.h"
 #include "fl_logger.h"
 #include "fl_rec.h"
 #include "fl_vm.h"
 
+/* Obtain a pseudo-random number (xorshift). */
+static unsigned int randomnumber(struct lua_State *L) {
+  unsigned int x = L->fl.seed;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  L->fl.seed = x;
+  return x;
+}
+
 void flvm_profile(struct lua_State *L, CallInfo *ci, int loopcount) {
   fll_assert(loopcount > 0, "flprof_profile: loopcount <= 0");
-  if (!flrec_isrecording(L)) {
+  if (!flrec_isrecording(L) && !flvm_hooked(L)) {
     Proto *p = getproto(ci->func);
     Instruction *i = fli_currentinstr(ci, p);
-    int *count = &fli_getext(p, i)->u.count;
-    fll_assert(*count < FL_JIT_THRESHOLD, "threshold already reached");
-    *count += loopcount;
-    if (*count >= FL_JIT_THRESHOLD) {
-      fli_reset(p, i);
-      flrec_start(L);
+    struct FLInstrExt *ext = fli_getext(p, i);
+    if (fli_isfl(fli_getloop(i, ext->original)))
+      return; /* loop already compiled or waiting to be recorded */
+    ext->u.prof.count += loopcount;
+    if (ext->u.prof.count >= ext->u.prof.threshold) {
+      TValue *ra = ci->u.l.base + GETARG_A(ext->original);
+      ext->u.prof.count = 0;
+      if (GET_OPCODE(ext->original) == OP_TFORCALL &&
+          !ttislcf(ra) && !ttisCclosure(ra))
+        flvm_penalize(L, p, i); /* Lua iterators can't be recorded */
+      else
+        flrec_start(L);
+    }
+  }
+}
+
+void flvm_penalize(struct lua_State *L, struct Proto *p, Instruction *prof) {
+  struct FLInstrExt *ext;
+  if (!fli_isfl(prof)) return; /* already blacklisted */
+  ext = fli_getext(p, prof);
+  ext->u.prof.count = 0;
+  if (++ext->u.prof.nfails >= FL_JIT_MAXFAILS) {
+    fllogln("flvm_penalize: loop blacklisted (%p)", (void *)prof);
+    fli_reset(p, prof);
+  }
+  else {
+    unsigned int noise = randomnumber(L) & ((1 << FL_JIT_PENALTYBITS) - 1);
+    int threshold = ext->u.prof.threshold * 2 + noise;
+    if (threshold > FL_JIT_MAXTHRESHOLD)
+      threshold = FL_JIT_MAXTHRESHOLD;
+    ext->u.prof.threshold = threshold;
+    fllogln("flvm_penalize: new threshold %d (%p)", threshold,
+            (void *)prof);
+  }
+}
+
+int flvm_calltrace(struct lua_State *L, struct lua_TValue *base,
+                   struct Proto *p, Instruction *loop) {
+  if (!fli_isexec(loop) || flvm_hooked(L)) return FL_EARLY_EXIT;
+  return flasm_execute(L, p, loop, base);
+}
+
+int flvm_newversion(struct lua_State *L, struct Proto *p,
+                    Instruction *loop, Instruction original) {
+  Instruction *prof = fli_getprof(loop, original);
+  if (flrec_isrecording(L) || !fli_isfl(prof) || flvm_hooked(L))
+    return 0;
+  if (flasm_nversions(p, loop) >= FL_JIT_MAXVERSIONS) {
+    /* No room for another version: the entries that none of them accept
+     * count as failures, until the loop is left to the interpreter. The
+     * profiling counter is idle while the loop is compiled. */
+    struct FLInstrExt *ext = fli_getext(p, prof);
+    if (++ext->u.prof.count >= ext->u.prof.threshold) {
+      flvm_penalize(L, p, prof);
+      if (!fli_isfl(prof) && G(L)->fl.running == 0) {
+        fllogln("flvm_newversion: dropping the versions (%p)", (void *)loop);
+        flasm_destroy(L, p, loop);
+      }
+    }
+    return 0;
+  }
+  fllogln("flvm_newversion: recording a new version (%p)", (void *)loop);
+  flrec_start(L);
+  return 1;
+}
+
+/* Finish a runtime call that may have run the GC. */
+static int endcall(struct lua_State *L, StkId base,
+                   const Instruction *savedpc) {
+  CallInfo *ci = L->ci;
+  L->top = ci->top;
+  if (ci->u.l.base != base)  /* a finalizer reallocated the stack */
+    return FL_SIDE_EXIT;
+  if (flvm_hooked(L))  /* the call set a hook; leave after the call */
+    return FL_SIDE_EXIT;
+  ci->u.l.savedpc = savedpc;
+  return FL_SUCCESS;
+}
+
+int flvm_checkgc(struct lua_State *L, const Instruction *pc) {
+  CallInfo *ci = L->ci;
+  StkId base = ci->u.l.base;
+  const Instruction *savedpc = ci->u.l.savedpc;
+  ci->u.l.savedpc = pc;  /* a finalizer may reallocate the stack */
+  luaC_condGC(L, L->top = ci->top, (void)0);
+  return endcall(L, base, savedpc);
+}
+
+int flvm_concat(struct lua_State *L, const Instruction *pc) {
+  CallInfo *ci = L->ci;
+  StkId base = ci->u.l.base;
+  const Instruction *savedpc = ci->u.l.savedpc;
+  Instruction i = *pc;
+  int b = GETARG_B(i);
+  int c = GETARG_C(i);
+  StkId ra, rb;
+  ci->u.l.savedpc = pc + 1;  /* for error messages */
+  L->top = base + c + 1;
+  luaV_concat(L, c - b + 1);
+  ra = base + GETARG_A(i);
+  rb = base + b;
+  setobjs2s(L, ra, rb);
+  luaC_condGC(L, L->top = (ra >= rb ? ra + 1 : rb), (void)0);
+  return endcall(L, base, savedpc);
+}
+
+int flvm_callc(struct lua_State *L, const Instruction *pc) {
+  CallInfo *ci = L->ci;
+  StkId base = ci->u.l.base;
+  const Instruction *savedpc = ci->u.l.savedpc;
+  Instruction i = *pc;
+  StkId ra = base + GETARG_A(i);
+  ci->u.l.savedpc = pc + 1;  /* the function may yield or raise an error */
+  if (GETARG_B(i) != 0)
+    L->top = ra + GETARG_B(i);
+  luaD_precall(L, ra, GETARG_C(i) - 1);
+  return endcall(L, base, savedpc);
+}
+
+int flvm_vararg(struct lua_State *L, const Instruction *pc) {
+  CallInfo *ci = L->ci;
+  StkId base = ci->u.l.base;
+  const Instruction *savedpc = ci->u.l.savedpc;
+  int n = cast_int(base - ci->func) - getproto(ci->func)->numparams - 1;
+  StkId ra, newbase;
+  int j;
+  if (n < 0) n = 0;
+  ci->u.l.savedpc = pc + 1;  /* for the stack overflow error */
+  luaD_checkstack(L, n);
+  newbase = ci->u.l.base;
+  ra = newbase + GETARG_A(*pc);
+  for (j = 0; j < n; j++)
+    setobjs2s(L, ra + j, newbase - n + j);
+  L->top = ra + n;
+  if (newbase != base)  /* resume at the call */
+    return FL_SIDE_EXIT;
+  ci->u.l.savedpc = savedpc;
+  return FL_SUCCESS;
+}
+
+/* Same as lstrlib's posrelat. */
+static lua_Integer posrelat(lua_Integer pos, size_t len) {
+  if (pos >= 0) return pos;
+  else if (0u - (size_t)pos > len) return 0;
+  else return (lua_Integer)len + pos + 1;
+}
+
+lua_Integer flvm_strbyte(struct TString *s, lua_Integer i) {
+  size_t l = tsslen(s);
+  i = posrelat(i, l);
+  if (i < 1 || i > (lua_Integer)l) return -1;
+  return cast_uchar(getstr(s)[i - 1]);
+}
+
+/* Store the result of a string fast path and run the GC. */
+static int endstrcall(struct lua_State *L, const Instruction *pc,
+                      const char *str, size_t l) {
+  CallInfo *ci = L->ci;
+  StkId base = ci->u.l.base;
+  const Instruction *savedpc = ci->u.l.savedpc;
+  StkId ra = base + GETARG_A(*pc);
+  ci->u.l.savedpc = pc + 1;  /* for error messages */
+  setsvalue2s(L, ra, luaS_newlstr(L, str, l));
+  luaC_condGC(L, L->top = ra + 1, (void)0);
+  return endcall(L, base, savedpc);
+}
+
+int flvm_strsub(struct lua_State *L, const Instruction *pc, struct TString *s,
+                lua_Integer i, lua_Integer j) {
+  size_t l = tsslen(s);
+  lua_Integer start = posrelat(i, l);
+  lua_Integer end = posrelat(j, l);
+  if (start < 1) start = 1;
+  if (end > (lua_Integer)l) end = l;
+  if (start > end)
+    return endstrcall(L, pc, "", 0);
+  return endstrcall(L, pc, getstr(s) + start - 1, (size_t)(end - start) + 1);
+}
+
+int flvm_strchar(struct lua_State *L, const Instruction *pc, lua_Integer c) {
+  char ch = cast(char, cast_uchar(c));
+  return endstrcall(L, pc, &ch, 1);
+}
+
+const TValue *flvm_index(struct lua_State *L, GCObject *o, int tag,
+                         TString *key) {
+  TValue obj;
+  int loop;
+  setgcovalue(L, &obj, o);
+  lua_assert(rttype(&obj) == tag);
+  (void)tag;
+  for (loop = 0; loop < FL_JIT_MAXINDEXCHAIN; loop++) {
+    const TValue *tm;
+    if (ttistable(&obj)) {
+      Table *h = hvalue(&obj);
+      const TValue *res = luaH_getstr(h, key);
+      if (!ttisnil(res)) return res;
+      tm = fasttm(L, h->metatable, TM_INDEX);  /* uses the absent flags */
+      if (tm == NULL) return luaO_nilobject;
     }
+    else {
+      tm = luaT_gettmbyobj(L, &obj, TM_INDEX);
+      if (ttisnil(tm)) return NULL;
+    }
+    if (!ttistable(tm)) return NULL;
+    setobj(L, &obj, tm);
   }
+  return NULL;
+}
+
+const TValue *flvm_cachemiss(Table *h, TString *key, unsigned int *hint) {
+  const TValue *res = luaH_getshortstr(h, key);
+  if (res != luaO_nilobject)  /* 'i_val' is the first field of the node */
+    *hint = cast(unsigned int, cast(const Node *, res) - h->node);
+  return res;
 }
 
+struct Table *flvm_newtable(struct lua_State *L, const Instruction *pc) {
+  CallInfo *ci = L->ci;
+  StkId base = ci->u.l.base;
+  const Instruction *savedpc = ci->u.l.savedpc;
+  Instruction i = *pc;
+  int b = GETARG_B(i);
+  int c = GETARG_C(i);
+  StkId ra = base + GETARG_A(i);
+  Table *t;
+  ci->u.l.savedpc = pc + 1;  /* for error messages */
+  t = luaH_new(L);
+  sethvalue(L, ra, t);
+  if (b != 0 || c != 0)
+    luaH_resize(L, t, luaO_fb2int(b), luaO_fb2int(c));
+  luaC_condGC(L, L->top = ra + 1, (void)0);
+  return (endcall(L, base, savedpc) == FL_SUCCESS) ? t : NULL;
+}
+
+void flvm_barrierback(struct lua_State *L, struct Table *t) {
+  if (isblack(t))
+    luaC_barrierback_(L, t);
+}
+
+int flvm_tforcall(struct lua_State *L, const Instruction *pc, int a, int c) {
+  CallInfo *ci = L->ci;
+  StkId base = ci->u.l.base;
+  const Instruction *savedpc = ci->u.l.savedpc;
+  StkId ra = base + a;
+  StkId cb = ra + 3;  /* call base */
+  setobjs2s(L, cb + 2, ra + 2);
+  setobjs2s(L, cb + 1, ra + 1);
+  setobjs2s(L, cb, ra);
+  ci->u.l.savedpc = pc + 1;  /* the function may yield or raise an error */
+  L->top = cb + 3;
+  luaD_call(L, cb, c);
+  return endcall(L, base, savedpc);
+}
+
+lua_Integer flvm_tablecursor(struct lua_State *L, struct Table *t, int a) {
+  return luaH_findindex(L, t, L->ci->u.l.base + a + 2);
+}
+
+lua_Integer flvm_tablenext(struct lua_State *L, struct Table *t,
+                           lua_Integer cursor, int a, int c) {
+  StkId ra = L->ci->u.l.base + a + 3;
+  unsigned int i = cast(unsigned int, cursor);
+  const TValue *key = NULL, *val = NULL;
+  TValue k;
+  for (; i < t->sizearray; i++) {  /* array part */
+    if (!ttisnil(&t->array[i])) {
+      setivalue(&k, i + 1);
+      key = &k;
+      val = &t->array[i];
+      break;
+    }
+  }
+  if (!key) {
+    for (i -= t->sizearray; cast_int(i) < sizenode(t); i++) {  /* hash part */
+      if (!ttisnil(gval(gnode(t, i)))) {
+        key = gkey(gnode(t, i));
+        val = gval(gnode(t, i));
+        i += t->sizearray;
+        break;
+      }
+    }
+    if (!key) return -1;
+  }
+  setobj2s(L, ra, key);
+  if (c >= 2) setobj2s(L, ra + 1, val);
+  for (c -= 2, ra += 2; c > 0; --c, ++ra)
+    setnilvalue(ra);
+  return cast(lua_Integer, i) + 1;
+}
@@ -29,16 +29,149 @@
 #ifndef fl_vm_h
 #define fl_vm_h
 
+#include "lua.h"
+
 #include "fl_instr.h"
 
 struct lua_State;
 struct lua_TValue;
+struct Proto;
+struct TString;
+struct Table;
+struct GCObject;
+
+/* C functions with fast paths in the traces. */
+enum FLBuiltin {
+  FLB_NONE,
+  FLB_STRBYTE,
+  FLB_STRSUB,
+  FLB_STRCHAR,
+  FLB_IPAIRS,
+  FLB_NEXT,
+  FLB_SELECT,
+  FLB_SELECTCOUNT
+};
+
+/* Builtin functions defined in lstrlib.c */
+LUAI_DDEC const lua_CFunction flstr_byte;
+LUAI_DDEC const lua_CFunction flstr_sub;
+LUAI_DDEC const lua_CFunction flstr_char;
+
+/* Iterators defined in lbaselib.c */
+LUAI_DDEC const lua_CFunction flbase_next;
+LUAI_DDEC const lua_CFunction flbase_ipairsaux;
+LUAI_DDEC const lua_CFunction flbase_select;
+
+/* Count and line hooks need the interpreter: while they are set, the loops
+ * aren't profiled or recorded and the traces aren't entered. */
+#define flvm_hooked(L)	((L)->hookmask & (LUA_MASKLINE | LUA_MASKCOUNT))
 
 /* Counts the number of times that a loop is executed. When the inner part of
  * the loop is executed enough times (JIT_THRESHOLD), the fl_rec module is
  * called and the trace is recorded.  */
 void flvm_profile(struct lua_State *L, CallInfo *ci, int loopcount);
 
+/* Penalizes the loop after a failed recording or a discarded trace. The
+ * threshold grows exponentially (with some random noise, so loops that fail
+ * together don't retry together) and the loop is blacklisted after
+ * FL_JIT_MAXFAILS attempts. */
+void flvm_penalize(struct lua_State *L, struct Proto *p, Instruction *prof);
+
+/* None of the compiled versions of the loop accepted the types at the loop
+ * entry. Start recording a new version if the loop isn't blacklisted and the
+ * maximum number of versions wasn't reached. Return 1 if the recording
+ * started. */
+int flvm_newversion(struct lua_State *L, struct Proto *p,
+                    Instruction *loop, Instruction original);
+
+/* Called by an outer trace to execute the trace of an inner loop. Return
+ * FL_EARLY_EXIT if the inner loop isn't compiled anymore. */
+int flvm_calltrace(struct lua_State *L, struct lua_TValue *base,
+                   struct Proto *p, Instruction *loop);
+
+/* Called by a trace at the loop back-edge when the GC has debt, with the
+ * registers already in the stack. 'pc' is the start of the trace loop.
+ * Return the same of flvm_callc. */
+int flvm_checkgc(struct lua_State *L, const Instruction *pc);
+
+/* Called by a trace to execute OP_CONCAT at 'pc'. The operands must be
+ * strings or numbers. Return FL_SIDE_EXIT, with the resume point already
+ * set, if the GC step moved the stack. */
+int flvm_concat(struct lua_State *L, const Instruction *pc);
+
+/* Called by a trace to execute OP_CALL at 'pc' when the function is a C
+ * function, with the registers already in the stack (and L->top set by the
+ * previous OP_VARARG if B is 0). Return FL_SIDE_EXIT, with the resume point
+ * already set, if the stack moved. */
+int flvm_callc(struct lua_State *L, const Instruction *pc);
+
+/* Called by a trace to execute OP_VARARG at 'pc' with B equal to 0. The
+ * varargs are copied and L->top is set for the next call. Return the same of
+ * flvm_callc. */
+int flvm_vararg(struct lua_State *L, const Instruction *pc);
+
+/* Fast path of string.byte(s, i). Return -1 if 'i' is out of range. */
+lua_Integer flvm_strbyte(struct TString *s, lua_Integer i);
+
+/* Fast paths of string.sub(s, i, j) and string.char(c) for the OP_CALL at
+ * 'pc'. The result is stored in the stack and the return value is the same
+ * of flvm_callc. */
+int flvm_strsub(struct lua_State *L, const Instruction *pc, struct TString *s,
+                lua_Integer i, lua_Integer j);
+int flvm_strchar(struct lua_State *L, const Instruction *pc, lua_Integer c);
+
+/* Index the object (a table or a string) with a string key, following the
+ * __index chain while it only has tables. Return NULL if the access needs a
+ * metamethod function (or raises an error). */
+const struct lua_TValue *flvm_index(struct lua_State *L, struct GCObject *o,
+                                    int tag, struct TString *key);
+
+/* Called by a trace to execute OP_NEWTABLE at 'pc'. The table is presized
+ * with the hints of the instruction and the GC step is checked. Return NULL,
+ * with the resume point already set, if the stack moved. */
+struct Table *flvm_newtable(struct lua_State *L, const Instruction *pc);
+
+/* Barrier of the values stored by a trace in the table. */
+void flvm_barrierback(struct lua_State *L, struct Table *t);
+
+/* Called by a trace to execute the OP_TFORCALL at 'pc', with A and C given
+ * because the instruction may be a FL one. The iterator must be a C function.
+ * Return the same of flvm_callc. */
+int flvm_tforcall(struct lua_State *L, const Instruction *pc, int a, int c);
+
+/* Traversal of the next() fast path. The cursor is the position of the
+ * control variable R(A+2) in the traversal order. flvm_tablenext stores the
+ * next key and value in R(A+3) and R(A+4) (up to 'c' results) and returns
+ * the new cursor, or -1 at the end of the table. */
+lua_Integer flvm_tablecursor(struct lua_State *L, struct Table *t, int a);
+lua_Integer flvm_tablenext(struct lua_State *L, struct Table *t,
+                           lua_Integer cursor, int a, int c);
+
+/* Inline caches of GETTABUP, GETTABLE and SELF with short string keys. Each
+ * instruction keeps the node index of the key in the last table accessed, so
+ * a hit only checks the key of that node; the hint is validated against the
+ * current table, then it also holds for other tables with the same layout.
+ * flvm_cachemiss looks up the key and updates the hint. Both return the value
+ * slot, that is nil if the key is absent. */
+#define flvm_gethint(p, ci) \
+  ((p)->fl.icache + fli_instrindex(p, fli_currentinstr(ci, p)))
+
+#define flvm_cachedget(h, key, hint) \
+  (*(hint) < cast(unsigned int, sizenode(h)) && \
+   ttisshrstring(gkey(gnode(h, *(hint)))) && \
+   tsvalue(gkey(gnode(h, *(hint)))) == (key) ? \
+   cast(const TValue *, gval(gnode(h, *(hint)))) : \
+   flvm_cachemiss(h, key, hint))
+
+const struct lua_TValue *flvm_cachemiss(struct Table *h, struct TString *key,
+                                        unsigned int *hint);
+
+/* Execute the original loop instruction (FORLOOP or TFORLOOP). */
+#define flvm_gotoloop(i) { \
+  if (GET_OPCODE(i) == OP_FORLOOP) goto l_forloop; \
+  else goto l_tforloop; \
+}
+
 #define flvm_execute() { \
   Proto *p = cl->p; \
   Instruction *currinstr = fli_currentinstr(ci, p); \
@@ -59,7 +192,7 @@ void flvm_profile(struct lua_State *L, CallInfo *ci, int loopcount);
         setivalue(plimit, ilimit); \
         setivalue(init, intop(-, initv, ivalue(pstep))); \
         if (ivalue(pstep) == 0) \
-          loopcount = FL_JIT_THRESHOLD; \
+          loopcount = FL_JIT_MAXTHRESHOLD; \
         else \
           loopcount = intop(/, intop(-, ilimit, ivalue(init)), ivalue(pstep)); \
       } \
@@ -75,30 +208,51 @@ void flvm_profile(struct lua_State *L, CallInfo *ci, int loopcount);
           luaG_runerror(L, "'for' initial value must be a number"); \
         setfltvalue(init, luai_numsub(L, ninit, nstep)); \
         if (nstep == 0.0) \
-          loopcount = FL_JIT_THRESHOLD; \
+          loopcount = FL_JIT_MAXTHRESHOLD; \
         else \
           loopcount = cast_int((nlimit - fltvalue(init)) / nstep); \
       } \
       if (loopcount > 0) { \
-        short lc = (loopcount > FL_JIT_THRESHOLD ? \
-                    FL_JIT_THRESHOLD : loopcount); \
+        int lc = (loopcount > FL_JIT_MAXTHRESHOLD ? \
+                  FL_JIT_MAXTHRESHOLD : loopcount); \
         flvm_profile(L, ci, lc); \
       } \
       ci->u.l.savedpc += GETARG_sBx(i); \
       break; \
     } \
-    case FLOP_FORLOOP_EXEC: { \
-      AsmFunction f = flasm_getfunction(p, currinstr); \
-      switch (f(L, base)) { \
+    case FLOP_TFORCALL_PROF: { \
+      flvm_profile(L, ci, 1); \
+      goto l_tforcall; \
+    } \
+    case FLOP_LOOP_REC: { \
+      /* record the loop starting at this iteration */ \
+      fli_reset(p, currinstr); \
+      if (flrec_isrecording(L) || flvm_hooked(L)) \
+        flvm_gotoloop(i); \
+      flrec_start(L); \
+      ci->u.l.savedpc = currinstr; \
+      break; \
+    } \
+    case FLOP_LOOP_EXEC: { \
+      int status; \
+      if (flvm_hooked(L)) \
+        flvm_gotoloop(i); \
+      /* runtime calls inside the trace may reallocate the stack */ \
+      Protect(status = flasm_execute(L, p, currinstr, base)); \
+      ra = RA(i); \
+      switch (status) { \
         case FL_SUCCESS: \
           break; \
         case FL_EARLY_EXIT: \
-          flasm_destroy(L, p, currinstr); \
-          goto l_forloop; \
+          /* record the loop starting at this iteration */ \
+          if (flvm_newversion(L, p, currinstr, i)) { \
+            ci->u.l.savedpc = currinstr; \
+            break; \
+          } \
+          flvm_gotoloop(i); \
           break; \
         case FL_SIDE_EXIT: \
-          flasm_destroy(L, p, currinstr); \
-          lua_assert(0); \
+          /* the trace already set the savedpc */ \
           break; \
         default: \
           lua_assert(0); \
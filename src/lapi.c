@@ -1078,7 +1078,8 @@ LUA_API int lua_gc (lua_State *L, int what, int data) {
         luaC_checkGC(L);
       }
       g->gcrunning = oldrunning;  /* restore previous state */
-      if (debt > 0 && g->gcstate == GCSpause)  /* end of cycle? */
+      /* end of cycle? (@@FastLua: each generational step is one) */
+      if (debt > 0 && (g->gcstate == GCSpause || isgenerational(g)))
         res = 1;  /* signal it */
       break;
     }
@@ -1097,6 +1098,18 @@ LUA_API int lua_gc (lua_State *L, int what, int data) {
       res = g->gcrunning;
       break;
     }
+    case LUA_GCGEN: {  /* @@FastLua */
+      res = isgenerational(g) ? LUA_GCGEN : LUA_GCINC;  /* previous mode */
+      if (data != 0)  /* set the growth between minor collections */
+        g->genminormul = cast_byte(data < 1 ? 1 : data > 255 ? 255 : data);
+      luaC_changemode(L, KGC_GEN);
+      break;
+    }
+    case LUA_GCINC: {  /* @@FastLua */
+      res = isgenerational(g) ? LUA_GCGEN : LUA_GCINC;  /* previous mode */
+      luaC_changemode(L, KGC_NORMAL);
+      break;
+    }
     default: res = -1;  /* invalid option */
   }
   lua_unlock(L);
@@ -1162,6 +1175,17 @@ LUA_API void lua_len (lua_State *L, int idx) {
 }
 
 
+/* @@FastLua: raw removal of all entries, keeping the allocated parts */
+LUA_API void lua_cleartable (lua_State *L, int idx) {
+  StkId t;
+  lua_lock(L);
+  t = index2addr(L, idx);
+  api_check(L, ttistable(t), "table expected");
+  luaH_clear(hvalue(t));
+  lua_unlock(L);
+}
+
+
 LUA_API lua_Alloc lua_getallocf (lua_State *L, void **ud) {
   lua_Alloc f;
   lua_lock(L);
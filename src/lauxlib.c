@@ -997,6 +997,316 @@ LUALIB_API const char *luaL_gsub (lua_State *L, const char *s, const char *p,
 }
 
 
+/*
+** {======================================================
+** @@FastLua: Pool allocator
+** Blocks up to POOLMAX bytes (tables, nodes, short strings, closures,
+** upvalues...) are served from per-state pools, one for each size
+** class, made of aligned pages of POOLPAGE bytes. Each page keeps its
+** own list of free slots, so that a page whose slots are all free is
+** released right away (unless it is the last one with free slots in
+** its class). Larger blocks go to 'realloc'. Each pool also keeps a
+** hash set of its pages, so whether a block comes from the pool is
+** told by its address, not by the old size given by the caller.
+** =======================================================
+*/
+
+#if !defined(LUAL_USEPOOL) && defined(LUA_USE_POSIX) && \
+    !defined(LUAL_NOPOOL) && \
+    !defined(__SANITIZE_ADDRESS__)  /* let the sanitizer see each block */
+#define LUAL_USEPOOL
+#endif
+
+
+#if defined(LUAL_USEPOOL)
+
+#if defined(LUA_USE_BGSWEEP)
+#include <pthread.h>
+#endif
+
+#define POOLMAX		256  /* largest block served by the pools */
+#define POOLPAGE	(64 * 1024)  /* size (and alignment) of the pages */
+
+/* classes are 8 bytes apart up to 128 bytes, then 16 bytes apart */
+#define NPOOLCLASSES	24
+#define sizeclass(sz)	((sz) <= 128 ? ((sz) - 1) >> 3 : 8 + (((sz) - 1) >> 4))
+#define classsize(c)	((c) < 16 ? ((c) + 1) * 8 : ((c) - 7) * 16)
+
+#define ispooled(sz)	((sz) <= POOLMAX)
+
+
+typedef struct PoolPage {
+  struct PoolPage *prev, *next;  /* list of pages with free slots */
+  void *free;  /* list of free slots */
+  char *bump;  /* first slot never used */
+  unsigned int nused;  /* number of slots in use */
+  unsigned int nslots;  /* total number of slots */
+  int sclass;  /* size class of the page */
+} PoolPage;
+
+/* slots start after the page header, aligned to 16 bytes */
+#define PAGEHEAD	((sizeof(PoolPage) + 15) & ~(size_t)15)
+
+#define pageof(b)	((PoolPage *)((size_t)(b) & ~(size_t)(POOLPAGE - 1)))
+
+/* home slot of a page in a set of 'sz' (a power of 2) slots */
+#define pagehash(pg,sz)  \
+	((((size_t)(pg) / POOLPAGE) * 2654435761u) & ((sz) - 1))
+
+
+typedef struct Pool {
+  PoolPage *avail[NPOOLCLASSES];  /* pages with free slots, per class */
+  PoolPage **pageset;  /* all pages, open addressing with linear probing */
+  size_t sizepageset;  /* number of slots in 'pageset' (a power of 2) */
+  size_t nblocks;  /* live blocks (the pool goes away with the last one) */
+  luaL_AllocStats st;
+#if defined(LUA_USE_BGSWEEP)
+  pthread_mutex_t lock;  /* the collector may free blocks in another thread */
+#endif
+} Pool;
+
+
+#if defined(LUA_USE_BGSWEEP)
+#define lockpool(p)	pthread_mutex_lock(&(p)->lock)
+#define unlockpool(p)	pthread_mutex_unlock(&(p)->lock)
+#else
+#define lockpool(p)	((void)0)
+#define unlockpool(p)	((void)0)
+#endif
+
+
+/* slot of page 'pg' in the set, or the empty slot where it would go */
+static size_t findpage (Pool *p, PoolPage *pg) {
+  size_t i = pagehash(pg, p->sizepageset);
+  while (p->pageset[i] != NULL && p->pageset[i] != pg)
+    i = (i + 1) & (p->sizepageset - 1);
+  return i;
+}
+
+
+/* does block 'b' live in a page of the pool? */
+static int ownsblock (Pool *p, void *b) {
+  return (p->sizepageset > 0 &&
+          p->pageset[findpage(p, pageof(b))] == pageof(b));
+}
+
+
+static int addpage (Pool *p, PoolPage *pg) {
+  if ((p->st.pages + 1) * 2 > p->sizepageset) {  /* keep it half empty */
+    PoolPage **old = p->pageset;
+    size_t oldsize = p->sizepageset;
+    size_t i;
+    size_t size = (oldsize == 0) ? 16 : oldsize * 2;
+    PoolPage **set = (PoolPage **)calloc(size, sizeof(PoolPage *));
+    if (set == NULL)
+      return 0;
+    p->pageset = set;
+    p->sizepageset = size;
+    for (i = 0; i < oldsize; i++) {  /* rehash the pages */
+      if (old[i] != NULL)
+        set[findpage(p, old[i])] = old[i];
+    }
+    free(old);
+  }
+  p->pageset[findpage(p, pg)] = pg;
+  return 1;
+}
+
+
+static void removepage (Pool *p, PoolPage *pg) {
+  size_t mask = p->sizepageset - 1;
+  size_t i = findpage(p, pg);  /* the hole */
+  size_t j = i;
+  p->pageset[i] = NULL;
+  for (;;) {  /* move back the pages that probed past the hole */
+    PoolPage *q;
+    size_t h;
+    j = (j + 1) & mask;
+    if ((q = p->pageset[j]) == NULL)
+      break;
+    h = pagehash(q, p->sizepageset);
+    /* can 'q' fill the hole (its home slot is not in the cycle (i, j])? */
+    if ((j > i) ? (h <= i || h > j) : (h <= i && h > j)) {
+      p->pageset[i] = q;
+      p->pageset[j] = NULL;
+      i = j;
+    }
+  }
+}
+
+
+static PoolPage *newpage (Pool *p, int c) {
+  void *mem;
+  PoolPage *pg;
+  if (posix_memalign(&mem, POOLPAGE, POOLPAGE) != 0)
+    return NULL;
+  pg = (PoolPage *)mem;
+  if (!addpage(p, pg)) {
+    free(mem);
+    return NULL;
+  }
+  pg->prev = pg->next = NULL;
+  pg->free = NULL;
+  pg->bump = (char *)pg + PAGEHEAD;
+  pg->nused = 0;
+  pg->nslots = (unsigned int)((POOLPAGE - PAGEHEAD) / classsize(c));
+  pg->sclass = c;
+  p->avail[c] = pg;
+  p->st.pages++;
+  return pg;
+}
+
+
+static void unlinkpage (Pool *p, PoolPage *pg) {
+  if (pg->prev) pg->prev->next = pg->next;
+  else p->avail[pg->sclass] = pg->next;
+  if (pg->next) pg->next->prev = pg->prev;
+  pg->prev = pg->next = NULL;
+}
+
+
+static void *poolalloc (Pool *p, size_t sz) {
+  int c = (int)sizeclass(sz);
+  PoolPage *pg = p->avail[c];
+  void *b;
+  if (pg == NULL && (pg = newpage(p, c)) == NULL)
+    return NULL;
+  if (pg->free != NULL) {  /* reuse a free slot? */
+    b = pg->free;
+    pg->free = *(void **)b;
+  }
+  else {  /* take a new slot */
+    b = pg->bump;
+    pg->bump += classsize(c);
+  }
+  if (++pg->nused == pg->nslots)  /* page is full? */
+    unlinkpage(p, pg);
+  p->st.pooled += classsize(c);
+  return b;
+}
+
+
+static void poolfree (Pool *p, void *b) {
+  PoolPage *pg = pageof(b);
+  int c = pg->sclass;
+  *(void **)b = pg->free;
+  pg->free = b;
+  p->st.pooled -= classsize(c);
+  if (pg->nused-- == pg->nslots) {  /* page was full? */
+    pg->next = p->avail[c];  /* it has a free slot again */
+    if (pg->next) pg->next->prev = pg;
+    p->avail[c] = pg;
+  }
+  else if (pg->nused == 0 && (pg->prev != NULL || pg->next != NULL)) {
+    unlinkpage(p, pg);  /* release an empty page if it is not the last */
+    removepage(p, pg);
+    free(pg);
+    p->st.pages--;
+    p->st.released++;
+  }
+}
+
+
+/* free the pool and its remaining (empty) pages */
+static void freepool (Pool *p) {
+  int c;
+  for (c = 0; c < NPOOLCLASSES; c++) {
+    PoolPage *pg = p->avail[c];
+    while (pg != NULL) {
+      PoolPage *next = pg->next;
+      free(pg);
+      pg = next;
+    }
+  }
+#if defined(LUA_USE_BGSWEEP)
+  pthread_mutex_destroy(&p->lock);
+#endif
+  free(p->pageset);
+  free(p);
+}
+
+
+static void *poolrealloc (Pool *p, void *ptr, size_t osize, size_t nsize) {
+  void *nptr;
+  int inpool = (ptr != NULL && ownsblock(p, ptr));
+  if (nsize == 0) {  /* free a block */
+    if (ptr == NULL) return NULL;  /* nothing to free */
+    if (inpool) poolfree(p, ptr);
+    else free(ptr);
+    nptr = NULL;
+    p->nblocks--;
+  }
+  else if (ptr == NULL) {  /* new block */
+    nptr = ispooled(nsize) ? poolalloc(p, nsize) : malloc(nsize);
+    if (nptr == NULL) return NULL;
+    p->nblocks++;
+  }
+  else if (!inpool && !ispooled(nsize))  /* both large? */
+    nptr = realloc(ptr, nsize);
+  else if (inpool && ispooled(nsize) &&
+           (int)sizeclass(nsize) <= pageof(ptr)->sclass &&
+           (int)sizeclass(nsize) >= pageof(ptr)->sclass - 1)
+    nptr = ptr;  /* current slot is good enough */
+  else {  /* move block between a pool and 'realloc' or between pools */
+    nptr = ispooled(nsize) ? poolalloc(p, nsize) : malloc(nsize);
+    if (nptr == NULL) {
+      if (inpool && ispooled(nsize) &&
+          (int)sizeclass(nsize) <= pageof(ptr)->sclass)
+        return ptr;  /* keep the larger slot when shrinking */
+      return NULL;
+    }
+    memcpy(nptr, ptr, (osize < nsize) ? osize : nsize);
+    if (inpool) poolfree(p, ptr);
+    else free(ptr);
+  }
+  if (ptr != NULL && !inpool) p->st.large -= osize;
+  if (!ispooled(nsize)) p->st.large += nsize;
+  return nptr;
+}
+
+
+static void *l_alloc (void *ud, void *ptr, size_t osize, size_t nsize) {
+  Pool *p = (Pool *)ud;
+  void *nptr;
+  int done;
+  lockpool(p);
+  nptr = poolrealloc(p, ptr, (ptr == NULL) ? 0 : osize, nsize);
+  /* no more blocks: state was closed (or could not be created) */
+  done = (p->nblocks == 0);
+  unlockpool(p);
+  if (done)
+    freepool(p);
+  return nptr;
+}
+
+
+static Pool *newpool (void) {
+  Pool *p = (Pool *)malloc(sizeof(Pool));
+  if (p != NULL) {
+    memset(p, 0, sizeof(Pool));
+#if defined(LUA_USE_BGSWEEP)
+    pthread_mutex_init(&p->lock, NULL);
+#endif
+  }
+  return p;
+}
+
+
+LUALIB_API int luaL_allocstats (lua_State *L, luaL_AllocStats *st) {
+  void *ud;
+  Pool *p;
+  if (lua_getallocf(L, &ud) != l_alloc)
+    return 0;  /* state does not use the pools */
+  p = (Pool *)ud;
+  lockpool(p);
+  *st = p->st;
+  unlockpool(p);
+  st->pagesize = POOLPAGE;
+  return 1;
+}
+
+#else
+
 static void *l_alloc (void *ud, void *ptr, size_t osize, size_t nsize) {
   (void)ud; (void)osize;  /* not used */
   if (nsize == 0) {
@@ -1008,6 +1318,16 @@ static void *l_alloc (void *ud, void *ptr, size_t osize, size_t nsize) {
 }
 
 
+LUALIB_API int luaL_allocstats (lua_State *L, luaL_AllocStats *st) {
+  (void)L; (void)st;
+  return 0;  /* no pools */
+}
+
+#endif
+
+/* }====================================================== */
+
+
 static int panic (lua_State *L) {
   lua_writestringerror("PANIC: unprotected error in call to Lua API (%s)\n",
                         lua_tostring(L, -1));
@@ -1016,7 +1336,12 @@ static int panic (lua_State *L) {
 
 
 LUALIB_API lua_State *luaL_newstate (void) {
+#if defined(LUAL_USEPOOL)
+  Pool *p = newpool();
+  lua_State *L = (p == NULL) ? NULL : lua_newstate(l_alloc, p);
+#else
   lua_State *L = lua_newstate(l_alloc, NULL);
+#endif
   if (L) lua_atpanic(L, &panic);
   return L;
 }
@@ -83,6 +83,17 @@ LUALIB_API int (luaL_loadstring) (lua_State *L, const char *s);
 
 LUALIB_API lua_State *(luaL_newstate) (void);
 
+/* @@FastLua: statistics of the pools of the default allocator */
+typedef struct luaL_AllocStats {
+  size_t pooled;  /* bytes in the slots taken from the pools */
+  size_t large;  /* bytes in the larger blocks, from 'realloc' */
+  size_t pages;  /* number of pages held by the pools */
+  size_t pagesize;  /* size of each page */
+  size_t released;  /* number of empty pages given back */
+} luaL_AllocStats;
+
+LUALIB_API int (luaL_allocstats) (lua_State *L, luaL_AllocStats *st);
+
 LUALIB_API lua_Integer (luaL_len) (lua_State *L, int idx);
 
 LUALIB_API const char *(luaL_gsub) (lua_State *L, const char *s, const char *p,
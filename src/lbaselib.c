@@ -173,10 +173,10 @@ static int luaB_rawset (lua_State *L) {
 static int luaB_collectgarbage (lua_State *L) {
   static const char *const opts[] = {"stop", "restart", "collect",
     "count", "step", "setpause", "setstepmul",
-    "isrunning", NULL};
+    "isrunning", "generational", "incremental", NULL};
   static const int optsnum[] = {LUA_GCSTOP, LUA_GCRESTART, LUA_GCCOLLECT,
     LUA_GCCOUNT, LUA_GCSTEP, LUA_GCSETPAUSE, LUA_GCSETSTEPMUL,
-    LUA_GCISRUNNING};
+    LUA_GCISRUNNING, LUA_GCGEN, LUA_GCINC};
   int o = optsnum[luaL_checkoption(L, 1, "collect", opts)];
   int ex = (int)luaL_optinteger(L, 2, 0);
   int res = lua_gc(L, o, ex);
@@ -190,6 +190,10 @@ static int luaB_collectgarbage (lua_State *L) {
       lua_pushboolean(L, res);
       return 1;
     }
+    case LUA_GCGEN: case LUA_GCINC: {  /* @@FastLua: previous mode */
+      lua_pushstring(L, (res == LUA_GCGEN) ? "generational" : "incremental");
+      return 1;
+    }
     default: {
       lua_pushinteger(L, res);
       return 1;
@@ -250,6 +254,13 @@ static int ipairsaux (lua_State *L) {
 }
 
 
+#ifdef FL_ENABLE
+/* iterators with fast paths in the FastLua traces */
+LUAI_DDEF const lua_CFunction flbase_next = luaB_next;
+LUAI_DDEF const lua_CFunction flbase_ipairsaux = ipairsaux;
+#endif
+
+
 /*
 ** 'ipairs' function. Returns 'ipairsaux', given "table", 0.
 ** (The given "table" may not be a table.)
@@ -398,6 +409,12 @@ static int luaB_select (lua_State *L) {
 }
 
 
+#ifdef FL_ENABLE
+/* @@FastLua: select over the varargs has a fast path in the traces */
+LUAI_DDEF const lua_CFunction flbase_select = luaB_select;
+#endif
+
+
 /*
 ** Continuation function for 'pcall' and 'xpcall'. Both functions
 ** already pushed a 'true' before doing the call, so in case of success
@@ -29,6 +29,9 @@
 #include "ltm.h"
 #include "lvm.h"
 
+/* @@FastLua */
+#include "fl_instr.h"
+
 
 
 #define noLuaClosure(f)		((f) == NULL || (f)->c.tt == LUA_TCCL)
@@ -376,7 +379,7 @@ static int findsetreg (Proto *p, int lastpc, int reg) {
   int setreg = -1;  /* keep last instruction that changed 'reg' */
   int jmptarget = 0;  /* any code before this address is conditional */
   for (pc = 0; pc < lastpc; pc++) {
-    Instruction i = p->code[pc];
+    Instruction i = fli_getoriginal(p, p->code + pc);  /* @@FastLua */
     OpCode op = GET_OPCODE(i);
     int a = GETARG_A(i);
     switch (op) {
@@ -426,7 +429,7 @@ static const char *getobjname (Proto *p, int lastpc, int reg,
   /* else try symbolic execution */
   pc = findsetreg(p, lastpc, reg);
   if (pc != -1) {  /* could find instruction? */
-    Instruction i = p->code[pc];
+    Instruction i = fli_getoriginal(p, p->code + pc);  /* @@FastLua */
     OpCode op = GET_OPCODE(i);
     switch (op) {
       case OP_MOVE: {
@@ -475,7 +478,7 @@ static const char *getfuncname (lua_State *L, CallInfo *ci, const char **name) {
   TMS tm = (TMS)0;  /* to avoid warnings */
   Proto *p = ci_func(ci)->p;  /* calling function */
   int pc = currentpc(ci);  /* calling instruction index */
-  Instruction i = p->code[pc];  /* calling instruction */
+  Instruction i = fli_getoriginal(p, p->code + pc);  /* @@FastLua */
   if (ci->callstatus & CIST_HOOKED) {  /* was it called inside a hook? */
     *name = "?";
     return "hook";
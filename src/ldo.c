@@ -135,6 +135,9 @@ l_noret luaD_throw (lua_State *L, int errcode) {
 
 int luaD_rawrunprotected (lua_State *L, Pfunc f, void *ud) {
   unsigned short oldnCcalls = L->nCcalls;
+#ifdef FL_ENABLE
+  int oldrunning = G(L)->fl.running;  /* traces left by an error */
+#endif
   struct lua_longjmp lj;
   lj.status = LUA_OK;
   lj.previous = L->errorJmp;  /* chain new error handler */
@@ -144,6 +147,9 @@ int luaD_rawrunprotected (lua_State *L, Pfunc f, void *ud) {
   );
   L->errorJmp = lj.previous;  /* restore old error handler */
   L->nCcalls = oldnCcalls;
+#ifdef FL_ENABLE
+  G(L)->fl.running = oldrunning;
+#endif
   return lj.status;
 }
 
@@ -129,15 +129,15 @@ Proto *luaF_newproto (lua_State *L) {
 
 
 void luaF_freeproto (lua_State *L, Proto *f) {
+#ifdef FL_ENABLE
+  fl_closeproto(L, f);  /* uses 'code', so close it first */
+#endif
   luaM_freearray(L, f->code, f->sizecode);
   luaM_freearray(L, f->p, f->sizep);
   luaM_freearray(L, f->k, f->sizek);
   luaM_freearray(L, f->lineinfo, f->sizelineinfo);
   luaM_freearray(L, f->locvars, f->sizelocvars);
   luaM_freearray(L, f->upvalues, f->sizeupvalues);
-#ifdef FL_ENABLE
-  fl_closeproto(L, f);
-#endif
   luaM_free(L, f);
 }
 
@@ -61,9 +61,9 @@
 
 /*
 ** 'makewhite' erases all color bits then sets only the current white
-** bit
+** bit (@@FastLua: a white object is also young)
 */
-#define maskcolors	(~(bitmask(BLACKBIT) | WHITEBITS))
+#define maskcolors	(~(bitmask(BLACKBIT) | WHITEBITS | bitmask(OLDBIT)))
 #define makewhite(g,x)	\
  (x->marked = cast_byte((x->marked & maskcolors) | luaC_white(g)))
 
@@ -376,7 +376,7 @@ static void traverseweakvalue (global_State *g, Table *h) {
   }
   if (g->gcstate == GCSpropagate)
     linkgclist(h, g->grayagain);  /* must retraverse it in atomic phase */
-  else if (hasclears)
+  else if (hasclears || isgenerational(g))  /* @@FastLua: see 'atomic' */
     linkgclist(h, g->weak);  /* has to be cleared later */
 }
 
@@ -424,7 +424,7 @@ static int traverseephemeron (global_State *g, Table *h) {
     linkgclist(h, g->grayagain);  /* must retraverse it in atomic phase */
   else if (hasww)  /* table has white->white entries? */
     linkgclist(h, g->ephemeron);  /* have to propagate again */
-  else if (hasclears)  /* table has white keys? */
+  else if (hasclears || isgenerational(g))  /* has white keys? */
     linkgclist(h, g->allweak);  /* may have to clean white keys */
   return marked;
 }
@@ -729,12 +729,25 @@ static GCObject **sweeplist (lua_State *L, GCObject **p, lu_mem count);
 ** objects, where a dead object is one marked with the old (non current)
 ** white; change all non-dead objects back to white, preparing for next
 ** collection cycle. Return where to continue the traversal or NULL if
-** list is finished.
+** list is finished. (@@FastLua: in generational mode, the surviving
+** objects keep their colors and become old instead; as new objects are
+** created at the head of 'allgc', its sweep stops at the first old one.)
 */
 static GCObject **sweeplist (lua_State *L, GCObject **p, lu_mem count) {
   global_State *g = G(L);
   int ow = otherwhite(g);
-  int white = luaC_white(g);  /* current white */
+  int toclear, toset;  /* bits to clear and to set in all live objects */
+  int tostop;  /* stop sweep when this is true */
+  if (isgenerational(g)) {  /* minor collection? */
+    toclear = ~0;  /* clear nothing */
+    toset = bitmask(OLDBIT);  /* survivors are old */
+    tostop = (g->gcstate == GCSswpallgc) ? bitmask(OLDBIT) : 0;
+  }
+  else {
+    toclear = maskcolors;  /* clear all color bits + old bit */
+    toset = luaC_white(g);  /* make object white */
+    tostop = 0;  /* do not stop */
+  }
   while (*p != NULL && count-- > 0) {
     GCObject *curr = *p;
     int marked = curr->marked;
@@ -742,8 +755,10 @@ static GCObject **sweeplist (lua_State *L, GCObject **p, lu_mem count) {
       *p = curr->next;  /* remove 'curr' from list */
       freeobj(L, curr);  /* erase 'curr' */
     }
-    else {  /* change mark to 'white' */
-      curr->marked = cast_byte((marked & maskcolors) | white);
+    else {
+      if (testbits(marked, tostop))
+        return NULL;  /* stop sweeping this list */
+      curr->marked = cast_byte((marked & toclear) | toset);  /* update marks */
       p = &curr->next;  /* go to next element */
     }
   }
@@ -765,6 +780,243 @@ static GCObject **sweeptolive (lua_State *L, GCObject **p) {
 /* }====================================================== */
 
 
+/*
+** {======================================================
+** @@FastLua: Background sweep
+** During the (non emergency) sweep steps, the memory blocks released
+** by 'freeobj' are not given back to the allocation function right
+** away: 'luaM_realloc_' accounts for them as usual and queues them in
+** batches, and a helper thread does the actual calls to 'frealloc'.
+** Unlinking the dead objects and their other cleanups (string table,
+** upvalues, open threads) stay in the Lua thread, as they touch state
+** shared with the mutator. The allocation function must be thread safe.
+** =======================================================
+*/
+#if defined(LUA_USE_BGSWEEP)
+
+#include <pthread.h>
+
+/* number of blocks in a batch */
+#define BGBATCHSIZE	1024
+
+/* maximum number of queued batches (more are freed by the Lua thread) */
+#define BGMAXPENDING	64
+
+typedef struct BGBatch {
+  struct BGBatch *next;
+  lua_Alloc frealloc;  /* function to free the blocks */
+  void *ud;
+  int n;  /* number of blocks */
+  struct {
+    void *block;
+    size_t size;
+  } b[BGBATCHSIZE];
+} BGBatch;
+
+
+typedef struct BGSweeper {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t work;  /* signals new batches or 'stop' */
+  pthread_cond_t idle;  /* signals that all batches were freed */
+  BGBatch *queue;  /* batches to be freed */
+  BGBatch *spare;  /* batches already freed, to be reused */
+  BGBatch *current;  /* batch being filled by the Lua thread */
+  int npending;  /* number of batches in 'queue' */
+  int busy;  /* true while the helper thread frees a batch */
+  int stop;  /* asks the helper thread to finish */
+  int running;  /* false if the helper thread could not be created */
+} BGSweeper;
+
+
+static void freebatch (BGBatch *bt) {
+  int i;
+  for (i = 0; i < bt->n; i++)
+    (*bt->frealloc)(bt->ud, bt->b[i].block, bt->b[i].size, 0);
+  bt->n = 0;
+}
+
+
+static void *bgsweepthread (void *ud) {
+  BGSweeper *s = cast(BGSweeper *, ud);
+  pthread_mutex_lock(&s->lock);
+  for (;;) {
+    BGBatch *bt;
+    while (s->queue == NULL && !s->stop)
+      pthread_cond_wait(&s->work, &s->lock);
+    if (s->queue == NULL)  /* stopped and nothing left to free? */
+      break;
+    bt = s->queue;
+    s->queue = bt->next;
+    s->npending--;
+    s->busy = 1;
+    pthread_mutex_unlock(&s->lock);
+    freebatch(bt);
+    pthread_mutex_lock(&s->lock);
+    s->busy = 0;
+    bt->next = s->spare;
+    s->spare = bt;
+    if (s->queue == NULL)
+      pthread_cond_broadcast(&s->idle);
+  }
+  pthread_mutex_unlock(&s->lock);
+  return NULL;
+}
+
+
+/*
+** Create the helper thread (on the first sweep step). Its state lives
+** outside the accounted memory, as the batches do.
+*/
+static BGSweeper *bgsweeper (global_State *g) {
+  BGSweeper *s = g->bgsweeper;
+  if (s == NULL) {
+    s = cast(BGSweeper *, (*g->frealloc)(g->ud, NULL, 0, sizeof(BGSweeper)));
+    if (s == NULL) return NULL;  /* try again in the next step */
+    s->queue = s->spare = s->current = NULL;
+    s->npending = s->busy = s->stop = 0;
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->work, NULL);
+    pthread_cond_init(&s->idle, NULL);
+    s->running = (pthread_create(&s->thread, NULL, bgsweepthread, s) == 0);
+    g->bgsweeper = s;
+  }
+  return s->running ? s : NULL;
+}
+
+
+/*
+** Hand the current batch to the helper thread, or free it here if too
+** many batches are already waiting.
+*/
+static void submitbatch (BGSweeper *s) {
+  BGBatch *bt = s->current;
+  int queued = 0;
+  pthread_mutex_lock(&s->lock);
+  if (s->npending < BGMAXPENDING) {
+    bt->next = s->queue;
+    s->queue = bt;
+    s->npending++;
+    queued = 1;
+    pthread_cond_signal(&s->work);
+  }
+  pthread_mutex_unlock(&s->lock);
+  if (queued)
+    s->current = NULL;
+  else
+    freebatch(bt);  /* keep it as the current (now empty) batch */
+}
+
+
+/*
+** Queue the block being freed; return false if it must be freed now.
+*/
+int luaC_deferfree (global_State *g, void *block, size_t osize) {
+  BGSweeper *s = g->bgsweeper;
+  BGBatch *bt = s->current;
+  if (bt == NULL) {  /* get a new batch */
+    pthread_mutex_lock(&s->lock);
+    bt = s->spare;
+    if (bt != NULL) s->spare = bt->next;
+    pthread_mutex_unlock(&s->lock);
+    if (bt == NULL) {
+      bt = cast(BGBatch *, (*g->frealloc)(g->ud, NULL, 0, sizeof(BGBatch)));
+      if (bt == NULL) return 0;
+    }
+    bt->frealloc = g->frealloc;
+    bt->ud = g->ud;
+    bt->n = 0;
+    s->current = bt;
+  }
+  bt->b[bt->n].block = block;
+  bt->b[bt->n].size = osize;
+  if (++bt->n == BGBATCHSIZE)
+    submitbatch(s);
+  return 1;
+}
+
+
+static void bgbegin (global_State *g) {
+  g->gcdefer = (g->gckind != KGC_EMERGENCY && bgsweeper(g) != NULL);
+}
+
+
+#define bgend(g)	((g)->gcdefer = 0)
+
+
+/*
+** Hand the last (partial) batch to the helper thread, at the end of a
+** sweep phase.
+*/
+static void bgflush (global_State *g) {
+  BGSweeper *s = g->bgsweeper;
+  if (s != NULL && s->current != NULL && s->current->n > 0)
+    submitbatch(s);
+}
+
+
+/*
+** Free all blocks queued for freeing, waiting for the helper thread
+** (before an emergency collection).
+*/
+static void bgwait (global_State *g) {
+  BGSweeper *s = g->bgsweeper;
+  if (s != NULL && s->running) {
+    if (s->current != NULL)
+      freebatch(s->current);
+    pthread_mutex_lock(&s->lock);
+    while (s->queue != NULL || s->busy)
+      pthread_cond_wait(&s->idle, &s->lock);
+    pthread_mutex_unlock(&s->lock);
+  }
+}
+
+
+/*
+** Stop the helper thread, after it frees all queued batches, and free
+** its state.
+*/
+static void bgstop (global_State *g) {
+  BGSweeper *s = g->bgsweeper;
+  if (s != NULL) {
+    BGBatch *bt;
+    if (s->running) {
+      pthread_mutex_lock(&s->lock);
+      s->stop = 1;
+      pthread_cond_signal(&s->work);
+      pthread_mutex_unlock(&s->lock);
+      pthread_join(s->thread, NULL);
+    }
+    if (s->current != NULL) {  /* closing in the middle of a sweep? */
+      freebatch(s->current);
+      s->current->next = s->spare;
+      s->spare = s->current;
+    }
+    while ((bt = s->spare) != NULL) {
+      s->spare = bt->next;
+      (*g->frealloc)(g->ud, bt, sizeof(BGBatch), 0);
+    }
+    pthread_cond_destroy(&s->idle);
+    pthread_cond_destroy(&s->work);
+    pthread_mutex_destroy(&s->lock);
+    (*g->frealloc)(g->ud, s, sizeof(BGSweeper), 0);
+    g->bgsweeper = NULL;
+  }
+}
+
+#else
+
+#define bgbegin(g)	cast_void(0)
+#define bgend(g)	cast_void(0)
+#define bgflush(g)	cast_void(0)
+#define bgwait(g)	cast_void(0)
+#define bgstop(g)	cast_void(0)
+
+#endif
+
+/* }====================================================== */
+
+
 /*
 ** {======================================================
 ** Finalization
@@ -791,7 +1043,7 @@ static GCObject *udata2finalize (global_State *g) {
   o->next = g->allgc;  /* return it to 'allgc' list */
   g->allgc = o;
   resetbit(o->marked, FINALIZEDBIT);  /* object is "normal" again */
-  if (issweepphase(g))
+  if (issweepphase(g) || isgenerational(g))  /* @@FastLua: young again */
     makewhite(g, o);  /* "sweep" object */
   return o;
 }
@@ -967,6 +1219,7 @@ void luaC_freeallobjects (lua_State *L) {
   lua_assert(g->finobj == NULL);
   callallpendingfinalizers(L);
   lua_assert(g->tobefnz == NULL);
+  bgstop(g);  /* @@FastLua */
   g->currentwhite = WHITEBITS; /* this "white" makes all objects look dead */
   g->gckind = KGC_NORMAL;
   sweepwholelist(L, &g->finobj);
@@ -976,11 +1229,21 @@ void luaC_freeallobjects (lua_State *L) {
 }
 
 
+/* @@FastLua: turn black the weak tables in list 'l' */
+static void blackenlist (GCObject *l) {
+  for (; l != NULL; l = gco2t(l)->gclist) {
+    lua_assert(isgray(l));
+    gray2black(l);
+  }
+}
+
+
 static l_mem atomic (lua_State *L) {
   global_State *g = G(L);
   l_mem work;
   GCObject *origweak, *origall;
   GCObject *grayagain = g->grayagain;  /* save original list */
+  g->grayagain = NULL;  /* @@FastLua: minors reuse the new one */
   lua_assert(g->ephemeron == NULL && g->weak == NULL);
   lua_assert(!iswhite(g->mainthread));
   g->gcstate = GCSinsideatomic;
@@ -1016,6 +1279,14 @@ static l_mem atomic (lua_State *L) {
   /* clear values from resurrected weak tables */
   clearvalues(g, g->weak, origweak);
   clearvalues(g, g->allweak, origall);
+  if (isgenerational(g)) {  /* @@FastLua */
+    /* weak tables are kept gray, out of the barriers; as they are not
+       traversed again unless touched, they must turn black now */
+    blackenlist(g->weak);
+    blackenlist(g->allweak);
+    blackenlist(g->ephemeron);
+    g->weak = g->allweak = g->ephemeron = NULL;
+  }
   luaS_clearcache(g);
   g->currentwhite = cast_byte(otherwhite(g));  /* flip current white */
   work += g->GCmemtrav;  /* complete counting */
@@ -1027,7 +1298,9 @@ static lu_mem sweepstep (lua_State *L, global_State *g,
                          int nextstate, GCObject **nextlist) {
   if (g->sweepgc) {
     l_mem olddebt = g->GCdebt;
+    bgbegin(g);  /* @@FastLua: blocks freed here go to the sweep thread */
     g->sweepgc = sweeplist(L, g->sweepgc, GCSWEEPMAX);
+    bgend(g);
     g->GCestimate += g->GCdebt - olddebt;  /* update estimate */
     if (g->sweepgc)  /* is there still something to sweep? */
       return (GCSWEEPMAX * GCSWEEPCOST);
@@ -1050,7 +1323,11 @@ static lu_mem singlestep (lua_State *L) {
     }
     case GCSpropagate: {
       g->GCmemtrav = 0;
-      lua_assert(g->gray);
+      if (g->gray == NULL) {  /* @@FastLua: minor with nothing to traverse */
+        lua_assert(isgenerational(g));
+        g->gcstate = GCSatomic;
+        return 0;
+      }
       propagatemark(g);
        if (g->gray == NULL)  /* no more gray objects? */
         g->gcstate = GCSatomic;  /* finish propagate phase */
@@ -1074,7 +1351,9 @@ static lu_mem singlestep (lua_State *L) {
       return sweepstep(L, g, GCSswpend, NULL);
     }
     case GCSswpend: {  /* finish sweeps */
-      makewhite(g, g->mainthread);  /* sweep main thread */
+      if (!isgenerational(g))  /* @@FastLua: it stays gray, as all threads */
+        makewhite(g, g->mainthread);  /* sweep main thread */
+      bgflush(g);  /* @@FastLua */
       checkSizes(L, g);
       g->gcstate = GCScallfin;
       return 0;
@@ -1120,6 +1399,81 @@ static l_mem getdebt (global_State *g) {
   }
 }
 
+/*
+** {======================================================
+** @@FastLua: Generational mode
+** Objects that survive a (minor) collection become old and stay black,
+** and the collector rests in the propagate phase between collections.
+** So the barriers keep marking the young objects stored into old ones
+** (or turning gray again the tables that receive them), and a minor
+** collection runs a whole cycle from the gray lists without restarting:
+** it only traverses the young objects reachable from them (threads are
+** always gray), and its sweep of 'allgc' stops at the first old object.
+** When memory use after a minor collection is still above
+** 'genmajormul'% over its level after the last major collection, the
+** next step is a major (full) collection, which turns all objects back
+** to young.
+** =======================================================
+*/
+
+static void setminordebt (global_State *g) {
+  luaE_setdebt(g, -(cast(l_mem, gettotalbytes(g) / 100) * g->genminormul));
+}
+
+
+/*
+** Enter the generational mode, leaving the collector in the propagate
+** phase. (A 'GCestimate' of zero asks for a major collection.)
+*/
+static void entergen (lua_State *L, global_State *g) {
+  luaC_runtilstate(L, bitmask(GCSpropagate));
+  g->GCestimate = gettotalbytes(g);
+  setminordebt(g);
+}
+
+
+static void genstep (lua_State *L, global_State *g) {
+  if (g->GCestimate == 0)  /* signal for a major collection? */
+    luaC_fullgc(L, 0);  /* it goes back to the generational mode */
+  else {
+    lu_mem estimate = g->GCestimate;  /* memory after last major coll. */
+    luaC_runtilstate(L, bitmask(GCSpause));  /* run complete (minor) cycle */
+    g->gcstate = GCSpropagate;  /* skip restart */
+    if (gettotalbytes(g) > (estimate / 100) * (100 + g->genmajormul))
+      g->GCestimate = 0;  /* signal for a major collection */
+    else
+      g->GCestimate = estimate;  /* keep estimate from last major coll. */
+    setminordebt(g);
+  }
+}
+
+
+/*
+** Change the mode of the collector. Going back to incremental mode
+** sweeps all objects to turn them back to white (as white has not
+** changed, nothing extra will be collected).
+*/
+void luaC_changemode (lua_State *L, int mode) {
+  global_State *g = G(L);
+  if (mode == g->gckind) return;  /* nothing to change */
+  if (mode == KGC_GEN) {
+    /* finish current cycle until a consistent propagate phase */
+    luaC_runtilstate(L, bitmask(GCSpropagate));
+    g->gckind = KGC_GEN;
+    entergen(L, g);
+  }
+  else {
+    g->gckind = KGC_NORMAL;
+    entersweep(L);
+    luaC_runtilstate(L, bitmask(GCScallfin));
+    g->GCestimate = gettotalbytes(g);
+    setpause(g);
+  }
+}
+
+/* }====================================================== */
+
+
 /*
 ** performs a basic GC step when collector is running
 */
@@ -1130,6 +1484,10 @@ void luaC_step (lua_State *L) {
     luaE_setdebt(g, -GCSTEPSIZE * 10);  /* avoid being called too often */
     return;
   }
+  if (isgenerational(g)) {  /* @@FastLua */
+    genstep(L, g);
+    return;
+  }
   do {  /* repeat until pause or enough "credit" (negative debt) */
     lu_mem work = singlestep(L);  /* perform one single step */
     debt -= work;
@@ -1155,8 +1513,12 @@ void luaC_step (lua_State *L) {
 */
 void luaC_fullgc (lua_State *L, int isemergency) {
   global_State *g = G(L);
-  lua_assert(g->gckind == KGC_NORMAL);
-  if (isemergency) g->gckind = KGC_EMERGENCY;  /* set flag */
+  int origkind = g->gckind;
+  lua_assert(origkind != KGC_EMERGENCY);
+  if (isemergency)
+    bgwait(g);  /* @@FastLua: get back the memory queued for freeing */
+  /* @@FastLua: a major collection runs as a regular one */
+  g->gckind = isemergency ? KGC_EMERGENCY : KGC_NORMAL;  /* set flag */
   if (keepinvariant(g)) {  /* black objects? */
     entersweep(L); /* sweep everything to turn them back to white */
   }
@@ -1167,8 +1529,11 @@ void luaC_fullgc (lua_State *L, int isemergency) {
   /* estimate must be correct after a full GC cycle */
   lua_assert(g->GCestimate == gettotalbytes(g));
   luaC_runtilstate(L, bitmask(GCSpause));  /* finish collection */
-  g->gckind = KGC_NORMAL;
-  setpause(g);
+  g->gckind = origkind;
+  if (origkind == KGC_GEN)  /* @@FastLua */
+    entergen(L, g);
+  else
+    setpause(g);
 }
 
 /* }====================================================== */
@@ -55,10 +55,14 @@
 ** ones) must be kept. During a collection, the sweep
 ** phase may break the invariant, as objects turned white may point to
 ** still-black objects. The invariant is restored when sweep ends and
-** all objects are white again.
+** all objects are white again. (@@FastLua: the generational mode never
+** turns the surviving objects white, so it always keeps the invariant.)
 */
 
-#define keepinvariant(g)	((g)->gcstate <= GCSatomic)
+#define isgenerational(g)	((g)->gckind == KGC_GEN)
+
+#define keepinvariant(g)  \
+	(isgenerational(g) || (g)->gcstate <= GCSatomic)
 
 
 /*
@@ -79,6 +83,7 @@
 #define WHITE1BIT	1  /* object is white (type 1) */
 #define BLACKBIT	2  /* object is black */
 #define FINALIZEDBIT	3  /* object has been marked for finalization */
+#define OLDBIT		6  /* @@FastLua: object survived a minor collection */
 /* bit 7 is currently used by tests (luaL_checkmemory) */
 
 #define WHITEBITS	bit2mask(WHITE0BIT, WHITE1BIT)
@@ -142,6 +147,10 @@ LUAI_FUNC void luaC_barrierback_ (lua_State *L, Table *o);
 LUAI_FUNC void luaC_upvalbarrier_ (lua_State *L, UpVal *uv);
 LUAI_FUNC void luaC_checkfinalizer (lua_State *L, GCObject *o, Table *mt);
 LUAI_FUNC void luaC_upvdeccount (lua_State *L, UpVal *uv);
+LUAI_FUNC void luaC_changemode (lua_State *L, int mode);
+#if defined(LUA_USE_BGSWEEP)
+LUAI_FUNC int luaC_deferfree (global_State *g, void *block, size_t osize);
+#endif
 
 
 #endif
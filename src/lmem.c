@@ -82,6 +82,14 @@ void *luaM_realloc_ (lua_State *L, void *block, size_t osize, size_t nsize) {
 #if defined(HARDMEMTESTS)
   if (nsize > realosize && g->gcrunning)
     luaC_fullgc(L, 1);  /* force a GC whenever possible */
+#endif
+#if defined(LUA_USE_BGSWEEP)
+  /* @@FastLua: during a sweep step, the sweep thread frees the block */
+  if (nsize == 0 && g->gcdefer && block != NULL &&
+      luaC_deferfree(g, block, osize)) {
+    g->GCdebt -= realosize;
+    return NULL;
+  }
 #endif
   newblock = (*g->frealloc)(g->ud, block, osize, nsize);
   if (newblock == NULL && nsize > 0) {
@@ -33,6 +33,27 @@
 LUAI_DDEF const TValue luaO_nilobject_ = {NILCONSTANT};
 
 
+#if defined(LUA_NANBOXING)
+/* @@FastLua: tag indices of the NaN-boxed values (see 'nb_kindex') */
+LUAI_DDEF const lu_byte luaO_nbtag[16] = {
+  LUA_TNUMFLT, LUA_TNIL, LUA_TBOOLEAN, LUA_TLIGHTUSERDATA, LUA_TNUMINT,
+  LUA_TLCF, LUA_TDEADKEY, ctb(LUA_TSHRSTR), ctb(LUA_TLNGSTR),
+  ctb(LUA_TTABLE), ctb(LUA_TLCL), ctb(LUA_TCCL), ctb(LUA_TUSERDATA),
+  ctb(LUA_TTHREAD), LUA_TNIL, LUA_TNIL
+};
+
+#define nbindex(t)	[t] = nb_kindex(t)
+
+LUAI_DDEF const lu_byte luaO_nbindex[ctb(LUA_TCCL) + 1] = {
+  nbindex(LUA_TNIL), nbindex(LUA_TBOOLEAN), nbindex(LUA_TLIGHTUSERDATA),
+  nbindex(LUA_TNUMINT), nbindex(LUA_TLCF), nbindex(LUA_TDEADKEY),
+  nbindex(ctb(LUA_TSHRSTR)), nbindex(ctb(LUA_TLNGSTR)),
+  nbindex(ctb(LUA_TTABLE)), nbindex(ctb(LUA_TLCL)), nbindex(ctb(LUA_TCCL)),
+  nbindex(ctb(LUA_TUSERDATA)), nbindex(ctb(LUA_TTHREAD))
+};
+#endif
+
+
 /*
 ** converts an integer to a "floating point byte", represented as
 ** (eeeeexxx), where the real value is (1xxx) * 2^(eeeee - 1) if
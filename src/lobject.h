@@ -111,6 +111,8 @@ typedef union Value {
 } Value;
 
 
+#if !defined(LUA_NANBOXING)	/* { */
+
 #define TValuefields	Value value_; int tt_
 
 
@@ -130,6 +132,61 @@ typedef struct lua_TValue {
 /* raw type tag of a TValue */
 #define rttype(o)	((o)->tt_)
 
+#else				/* }{ */
+
+/*
+** @@FastLua: NaN boxing. A TValue is a single 64-bit word: floats are
+** stored as they are (with NaNs in a canonical form) and other values are
+** negative quiet NaNs with a tag index in bits 47-50 and a 47-bit payload
+** (a pointer, an integer or a boolean).
+*/
+typedef unsigned long long NBValue;
+
+#define TValuefields	union { NBValue nb_; lua_Number n_; } u_
+
+
+typedef struct lua_TValue {
+  TValuefields;
+} TValue;
+
+
+#define NB_TAGSHIFT	47
+#define NB_PAYLOAD	((cast(NBValue, 1) << NB_TAGSHIFT) - 1)
+#define NB_BOXED	0x1FFF0  /* 'nb_index' of the canonical NaN */
+#define NB_FIRSTGC	7  /* first tag index of collectable values */
+
+/* tag index of a constant raw tag ('luaO_nbindex' maps any raw tag) */
+#define nb_kindex(t)  \
+	((t) == LUA_TNIL ? 1 : (t) == LUA_TBOOLEAN ? 2 : \
+	 (t) == LUA_TLIGHTUSERDATA ? 3 : (t) == LUA_TNUMINT ? 4 : \
+	 (t) == LUA_TLCF ? 5 : (t) == LUA_TDEADKEY ? 6 : \
+	 (t) == ctb(LUA_TSHRSTR) ? 7 : (t) == ctb(LUA_TLNGSTR) ? 8 : \
+	 (t) == ctb(LUA_TTABLE) ? 9 : (t) == ctb(LUA_TLCL) ? 10 : \
+	 (t) == ctb(LUA_TCCL) ? 11 : (t) == ctb(LUA_TUSERDATA) ? 12 : 13)
+
+#define nb_tagbits(i)	(cast(NBValue, NB_BOXED + (i)) << NB_TAGSHIFT)
+#define nb_box(i,p)	(nb_tagbits(i) | (p))
+#define nb_index(w)	((w) >> NB_TAGSHIFT)
+#define nb_isfloat(w)	(nb_index(w) <= NB_BOXED)
+#define nb_payload(o)	((o)->u_.nb_ & NB_PAYLOAD)
+#define nb_pointer(o)	cast(void *, cast(size_t, nb_payload(o)))
+#define nb_ptrbits(p)	cast(NBValue, cast(size_t, p))
+
+/* canonical NaN (the default NaN of x86) */
+#define NB_NAN		nb_tagbits(0)
+
+
+/* macro defining a nil value */
+#define NILCONSTANT	{nb_tagbits(nb_kindex(LUA_TNIL))}
+
+
+/* raw type tag of a TValue */
+#define rttype(o)	nb_rttype((o)->u_.nb_)
+#define nb_rttype(w)  \
+	(nb_isfloat(w) ? LUA_TNUMFLT : luaO_nbtag[nb_index(w) - NB_BOXED])
+
+#endif				/* } */
+
 /* tag with no variants (bits 0-3) */
 #define novariant(x)	((x) & 0x0F)
 
@@ -141,15 +198,24 @@ typedef struct lua_TValue {
 
 
 /* Macros to test type */
+#if !defined(LUA_NANBOXING)
 #define checktag(o,t)		(rttype(o) == (t))
-#define checktype(o,t)		(ttnov(o) == (t))
 #define ttisnumber(o)		checktype((o), LUA_TNUMBER)
+#define ttisstring(o)		checktype((o), LUA_TSTRING)
+#else
+#define checktag(o,t)  \
+	((t) == LUA_TNUMFLT ? nb_isfloat((o)->u_.nb_) : \
+	 nb_index((o)->u_.nb_) == NB_BOXED + nb_kindex(t))
+#define ttisnumber(o)		(ttisfloat(o) || ttisinteger(o))
+#define ttisstring(o)  \
+	(nb_index((o)->u_.nb_) - (NB_BOXED + nb_kindex(ctb(LUA_TSHRSTR))) <= 1)
+#endif
+#define checktype(o,t)		(ttnov(o) == (t))
 #define ttisfloat(o)		checktag((o), LUA_TNUMFLT)
 #define ttisinteger(o)		checktag((o), LUA_TNUMINT)
 #define ttisnil(o)		checktag((o), LUA_TNIL)
 #define ttisboolean(o)		checktag((o), LUA_TBOOLEAN)
 #define ttislightuserdata(o)	checktag((o), LUA_TLIGHTUSERDATA)
-#define ttisstring(o)		checktype((o), LUA_TSTRING)
 #define ttisshrstring(o)	checktag((o), ctb(LUA_TSHRSTR))
 #define ttislngstring(o)	checktag((o), ctb(LUA_TLNGSTR))
 #define ttistable(o)		checktag((o), ctb(LUA_TTABLE))
@@ -164,6 +230,7 @@ typedef struct lua_TValue {
 
 
 /* Macros to access values */
+#if !defined(LUA_NANBOXING)	/* { */
 #define ivalue(o)	check_exp(ttisinteger(o), val_(o).i)
 #define fltvalue(o)	check_exp(ttisfloat(o), val_(o).n)
 #define nvalue(o)	check_exp(ttisnumber(o), \
@@ -182,11 +249,39 @@ typedef struct lua_TValue {
 /* a dead value may get the 'gc' field, but cannot access its contents */
 #define deadvalue(o)	check_exp(ttisdeadkey(o), cast(void *, val_(o).gc))
 
-#define l_isfalse(o)	(ttisnil(o) || (ttisboolean(o) && bvalue(o) == 0))
-
 
 #define iscollectable(o)	(rttype(o) & BIT_ISCOLLECTABLE)
 
+#else				/* }{ */
+#define ivalue(o)  check_exp(ttisinteger(o), \
+	l_castU2S(cast(lua_Unsigned, (o)->u_.nb_)))
+#define fltvalue(o)	check_exp(ttisfloat(o), (o)->u_.n_)
+#define nvalue(o)	check_exp(ttisnumber(o), \
+	(ttisinteger(o) ? cast_num(ivalue(o)) : fltvalue(o)))
+#define gcvalue(o)	check_exp(iscollectable(o), nb_gcvalue(o))
+#define pvalue(o)	check_exp(ttislightuserdata(o), nb_pointer(o))
+#define tsvalue(o)	check_exp(ttisstring(o), gco2ts(nb_gcvalue(o)))
+#define uvalue(o)	check_exp(ttisfulluserdata(o), gco2u(nb_gcvalue(o)))
+#define clvalue(o)	check_exp(ttisclosure(o), gco2cl(nb_gcvalue(o)))
+#define clLvalue(o)	check_exp(ttisLclosure(o), gco2lcl(nb_gcvalue(o)))
+#define clCvalue(o)	check_exp(ttisCclosure(o), gco2ccl(nb_gcvalue(o)))
+#define fvalue(o)  check_exp(ttislcf(o), \
+	cast(lua_CFunction, cast(size_t, nb_payload(o))))
+#define hvalue(o)	check_exp(ttistable(o), gco2t(nb_gcvalue(o)))
+#define bvalue(o)	check_exp(ttisboolean(o), cast_int(nb_payload(o)))
+#define thvalue(o)	check_exp(ttisthread(o), gco2th(nb_gcvalue(o)))
+/* a dead value may get the 'gc' field, but cannot access its contents */
+#define deadvalue(o)	check_exp(ttisdeadkey(o), nb_pointer(o))
+
+#define nb_gcvalue(o)	cast(GCObject *, nb_pointer(o))
+
+#define iscollectable(o)  \
+	(nb_index((o)->u_.nb_) >= NB_BOXED + NB_FIRSTGC)
+
+#endif				/* } */
+
+#define l_isfalse(o)	(ttisnil(o) || (ttisboolean(o) && bvalue(o) == 0))
+
 
 /* Macros for internal tests */
 #define righttt(obj)		(ttype(obj) == gcvalue(obj)->tt)
@@ -197,6 +292,7 @@ typedef struct lua_TValue {
 
 
 /* Macros to set values */
+#if !defined(LUA_NANBOXING)	/* { */
 #define settt_(o,t)	((o)->tt_=(t))
 
 #define setfltvalue(obj,x) \
@@ -258,6 +354,64 @@ typedef struct lua_TValue {
 
 #define setdeadvalue(obj)	settt_(obj, LUA_TDEADKEY)
 
+#else				/* }{ */
+/* keeps the payload (see 'setdeadvalue') */
+#define settt_(o,t)  \
+	((o)->u_.nb_ = nb_box(luaO_nbindex[t], nb_payload(o)))
+
+#define nb_set(obj,t,p)	((obj)->u_.nb_ = nb_box(nb_kindex(t), (p)))
+
+#define setfltvalue(obj,x) \
+  { TValue *io=(obj); io->u_.n_=(x); \
+    if (!nb_isfloat(io->u_.nb_)) io->u_.nb_ = NB_NAN; }
+
+#define chgfltvalue(obj,x) \
+  { lua_assert(ttisfloat(obj)); setfltvalue(obj,x); }
+
+#define setivalue(obj,x) \
+  nb_set(obj, LUA_TNUMINT, cast(NBValue, l_castS2U(x)))
+
+#define chgivalue(obj,x) \
+  { lua_assert(ttisinteger(obj)); setivalue(obj,x); }
+
+#define setnilvalue(obj)	nb_set(obj, LUA_TNIL, 0)
+
+#define setfvalue(obj,x)	nb_set(obj, LUA_TLCF, nb_ptrbits(x))
+
+/* light userdata keep only the low 47 bits */
+#define setpvalue(obj,x) \
+  nb_set(obj, LUA_TLIGHTUSERDATA, nb_ptrbits(x) & NB_PAYLOAD)
+
+#define setbvalue(obj,x) \
+  nb_set(obj, LUA_TBOOLEAN, cast(NBValue, cast(unsigned int, x)))
+
+#define setgcovalue(L,obj,x) \
+  { TValue *io = (obj); GCObject *i_g=(x); \
+    lua_assert((nb_ptrbits(i_g) & ~NB_PAYLOAD) == 0); \
+    io->u_.nb_ = nb_box(luaO_nbindex[ctb(i_g->tt)], nb_ptrbits(i_g)); }
+
+#define setsvalue(L,obj,x) \
+  { TValue *io = (obj); TString *x_ = (x); \
+    lua_assert((nb_ptrbits(x_) & ~NB_PAYLOAD) == 0); \
+    io->u_.nb_ = nb_box(luaO_nbindex[ctb(x_->tt)], nb_ptrbits(x_)); \
+    checkliveness(L,io); }
+
+#define nb_setgc(L,obj,t,x) \
+  { TValue *io = (obj); \
+    lua_assert((nb_ptrbits(x) & ~NB_PAYLOAD) == 0); \
+    nb_set(io, t, nb_ptrbits(x)); checkliveness(L,io); }
+
+#define setuvalue(L,obj,x)	nb_setgc(L,obj,ctb(LUA_TUSERDATA),x)
+#define setthvalue(L,obj,x)	nb_setgc(L,obj,ctb(LUA_TTHREAD),x)
+#define setclLvalue(L,obj,x)	nb_setgc(L,obj,ctb(LUA_TLCL),x)
+#define setclCvalue(L,obj,x)	nb_setgc(L,obj,ctb(LUA_TCCL),x)
+#define sethvalue(L,obj,x)	nb_setgc(L,obj,ctb(LUA_TTABLE),x)
+
+#define setdeadvalue(obj)  \
+	nb_set(obj, LUA_TDEADKEY, nb_payload(obj))
+
+#endif				/* } */
+
 
 
 #define setobj(L,obj1,obj2) \
@@ -352,7 +506,11 @@ typedef struct Udata {
   lu_byte ttuv_;  /* user value's tag */
   struct Table *metatable;
   size_t len;  /* number of bytes */
+#if !defined(LUA_NANBOXING)
   union Value user_;  /* user value */
+#else
+  TValue user_;  /* user value (boxed with its tag) */
+#endif
 } Udata;
 
 
@@ -372,6 +530,7 @@ typedef union UUdata {
 #define getudatamem(u)  \
   check_exp(sizeof((u)->ttuv_), (cast(char*, (u)) + sizeof(UUdata)))
 
+#if !defined(LUA_NANBOXING)
 #define setuservalue(L,u,o) \
 	{ const TValue *io=(o); Udata *iu = (u); \
 	  iu->user_ = io->value_; iu->ttuv_ = rttype(io); \
@@ -382,6 +541,17 @@ typedef union UUdata {
 	{ TValue *io=(o); const Udata *iu = (u); \
 	  io->value_ = iu->user_; settt_(io, iu->ttuv_); \
 	  checkliveness(L,io); }
+#else
+#define setuservalue(L,u,o) \
+	{ const TValue *io=(o); Udata *iu = (u); \
+	  iu->user_ = *io; iu->ttuv_ = rttype(io); \
+	  checkliveness(L,io); }
+
+
+#define getuservalue(L,u,o) \
+	{ TValue *io=(o); const Udata *iu = (u); \
+	  *io = iu->user_; checkliveness(L,io); }
+#endif
 
 
 /*
@@ -486,10 +656,16 @@ typedef union TKey {
 } TKey;
 
 
+#if !defined(LUA_NANBOXING)
+#define setnodekey_(k,o)  { (k)->nk.value_ = (o)->value_; (k)->nk.tt_ = (o)->tt_; }
+#else
+#define setnodekey_(k,o)	{ (k)->nk.u_.nb_ = (o)->u_.nb_; }
+#endif
+
 /* copy a value into a key without messing up field 'next' */
 #define setnodekey(L,key,obj) \
 	{ TKey *k_=(key); const TValue *io_=(obj); \
-	  k_->nk.value_ = io_->value_; k_->nk.tt_ = io_->tt_; \
+	  setnodekey_(k_, io_); \
 	  (void)L; checkliveness(L,io_); }
 
 
@@ -506,7 +682,12 @@ typedef struct Table {
   unsigned int sizearray;  /* size of 'array' array */
   TValue *array;  /* array part */
   Node *node;
+#if !defined(LUA_USE_SWISSTABLE)
   Node *lastfree;  /* any free position is before this position */
+#else
+  lu_byte *ctrl;  /* control bytes of the hash part (see ltable.c) */
+  unsigned int growth;  /* number of new keys that fit in the hash part */
+#endif
   struct Table *metatable;
   GCObject *gclist;
 } Table;
@@ -532,6 +713,12 @@ typedef struct Table {
 
 LUAI_DDEC const TValue luaO_nilobject_;
 
+#if defined(LUA_NANBOXING)
+/* raw tags of the tag indices and tag indices of the raw tags */
+LUAI_DDEC const lu_byte luaO_nbtag[16];
+LUAI_DDEC const lu_byte luaO_nbindex[ctb(LUA_TCCL) + 1];
+#endif
+
 /* size of buffer for 'luaO_utf8esc' function */
 #define UTF8BUFFSZ	8
 
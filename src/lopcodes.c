@@ -66,6 +66,11 @@ LUAI_DDEF const char *const luaP_opnames[NUM_OPCODES+1] = {
   "VARARG",
   "EXTRAARG",
   "OP_FLVM",
+  "ADDII",
+  "ADDFF",
+  "LTII",
+  "LTFF",
+  "GETARRAY",
   NULL
 };
 
@@ -121,5 +126,11 @@ LUAI_DDEF const lu_byte luaP_opmodes[NUM_OPCODES] = {
  ,opmode(0, 1, OpArgU, OpArgN, iABx)		/* OP_CLOSURE */
  ,opmode(0, 1, OpArgU, OpArgN, iABC)		/* OP_VARARG */
  ,opmode(0, 0, OpArgU, OpArgU, iAx)		/* OP_EXTRAARG */
+ ,opmode(0, 0, OpArgN, OpArgN, iABC)		/* OP_FLVM */
+ ,opmode(0, 1, OpArgK, OpArgK, iABC)		/* OP_ADDII */
+ ,opmode(0, 1, OpArgK, OpArgK, iABC)		/* OP_ADDFF */
+ ,opmode(1, 0, OpArgK, OpArgK, iABC)		/* OP_LTII */
+ ,opmode(1, 0, OpArgK, OpArgK, iABC)		/* OP_LTFF */
+ ,opmode(0, 1, OpArgR, OpArgK, iABC)		/* OP_GETARRAY */
 };
 
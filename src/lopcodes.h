@@ -231,11 +231,18 @@ OP_VARARG,/*	A B	R(A), R(A+1), ..., R(A+B-2) = vararg		*/
 OP_EXTRAARG,/*	Ax	extra (larger) argument for previous opcode	*/
 
 /* @@FastLua */
-OP_FLVM
+OP_FLVM,
+
+/* @@FastLua: quickened opcodes, only created by the interpreter */
+OP_ADDII,/*	A B C	R(A) := RK(B) + RK(C) (integers)		*/
+OP_ADDFF,/*	A B C	R(A) := RK(B) + RK(C) (floats)			*/
+OP_LTII,/*	A B C	if ((RK(B) <  RK(C)) ~= A) then pc++ (integers)	*/
+OP_LTFF,/*	A B C	if ((RK(B) <  RK(C)) ~= A) then pc++ (floats)	*/
+OP_GETARRAY/*	A B C	R(A) := R(B)[RK(C)] (array part)		*/
 } OpCode;
 
 
-#define NUM_OPCODES	(cast(int, OP_FLVM) + 1)
+#define NUM_OPCODES	(cast(int, OP_GETARRAY) + 1)
 
 
 
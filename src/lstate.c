@@ -40,6 +40,15 @@
 #define LUAI_GCMUL	200 /* GC runs 'twice the speed' of memory allocation */
 #endif
 
+/* @@FastLua: generational mode */
+#if !defined(LUAI_GENMINORMUL)
+#define LUAI_GENMINORMUL	20  /* minor collection after 20% growth */
+#endif
+
+#if !defined(LUAI_GENMAJORMUL)
+#define LUAI_GENMAJORMUL	100  /* major one when the heap doubles */
+#endif
+
 
 /*
 ** a macro to help the creation of a unique random seed when a state is
@@ -321,7 +330,7 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud) {
   g->seed = makeseed(L);
   g->gcrunning = 0;  /* no GC while building state */
   g->GCestimate = 0;
-  g->strt.size = g->strt.nuse = 0;
+  g->strt.size = g->strt.nuse = g->strt.split = 0;
   g->strt.hash = NULL;
   setnilvalue(&g->l_registry);
   g->panic = NULL;
@@ -338,7 +347,16 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud) {
   g->gcfinnum = 0;
   g->gcpause = LUAI_GCPAUSE;
   g->gcstepmul = LUAI_GCMUL;
+  g->genminormul = LUAI_GENMINORMUL;
+  g->genmajormul = LUAI_GENMAJORMUL;
+#if defined(LUA_USE_BGSWEEP)
+  g->gcdefer = 0;
+  g->bgsweeper = NULL;
+#endif
   for (i=0; i < LUA_NUMTAGS; i++) g->mt[i] = NULL;
+#ifdef FL_ENABLE
+  fl_initglobal(&g->fl);
+#endif
   if (luaD_rawrunprotected(L, f_luaopen, NULL) != LUA_OK) {
     /* memory allocation error: free partial state */
     close_state(L);
@@ -57,12 +57,14 @@ struct lua_longjmp;  /* defined in ldo.c */
 /* kinds of Garbage Collection */
 #define KGC_NORMAL	0
 #define KGC_EMERGENCY	1	/* gc was forced by an allocation failure */
+#define KGC_GEN		2	/* @@FastLua: generational gc (see lgc.c) */
 
 
 typedef struct stringtable {
   TString **hash;
   int nuse;  /* number of elements */
   int size;
+  int split;  /* @@FastLua: first bucket not split by a growth (lstring.c) */
 } stringtable;
 
 
@@ -147,6 +149,12 @@ typedef struct global_State {
   unsigned int gcfinnum;  /* number of finalizers to call in each GC step */
   int gcpause;  /* size of pause between successive GCs */
   int gcstepmul;  /* GC 'granularity' */
+  lu_byte genminormul;  /* @@FastLua: growth (%) between minor collections */
+  lu_byte genmajormul;  /* @@FastLua: growth (%) that asks for a major one */
+#if defined(LUA_USE_BGSWEEP)
+  lu_byte gcdefer;  /* @@FastLua: true while frees go to the sweep thread */
+  struct BGSweeper *bgsweeper;  /* @@FastLua: sweep thread (see lgc.c) */
+#endif
   lua_CFunction panic;  /* to be called in unprotected errors */
   struct lua_State *mainthread;
   const lua_Number *version;  /* pointer to version number */
@@ -154,6 +162,9 @@ typedef struct global_State {
   TString *tmname[TM_N];  /* array with tag-method names */
   struct Table *mt[LUA_NUMTAGS];  /* metatables for basic types */
   TString *strcache[STRCACHE_N][STRCACHE_M];  /* cache for strings in API */
+#ifdef FL_ENABLE
+  struct FLGlobalState fl;
+#endif
 } global_State;
 
 
@@ -26,11 +26,11 @@
 
 
 /*
-** Lua will use at most ~(2^LUAI_HASHLIMIT) bytes from a string to
-** compute its hash
+** @@FastLua: number of buckets moved by each new short string while the
+** string table grows (see 'splitbucket')
 */
-#if !defined(LUAI_HASHLIMIT)
-#define LUAI_HASHLIMIT		5
+#if !defined(LUAI_STRSPLITSTEP)
+#define LUAI_STRSPLITSTEP	2
 #endif
 
 
@@ -46,11 +46,35 @@ int luaS_eqlngstr (TString *a, TString *b) {
 }
 
 
+/*
+** @@FastLua: MurmurHash3 (32 bits) of the whole string, so that no part
+** of a string can be changed without changing its hash
+*/
+#define rotl32(x,n)	(((x) << (n)) | ((x) >> (32 - (n))))
+
+#define mixblock(k)	(rotl32((k) * 0xcc9e2d51u, 15) * 0x1b873593u)
+
 unsigned int luaS_hash (const char *str, size_t l, unsigned int seed) {
   unsigned int h = seed ^ cast(unsigned int, l);
-  size_t step = (l >> LUAI_HASHLIMIT) + 1;
-  for (; l >= step; l -= step)
-    h ^= ((h<<5) + (h>>2) + cast_byte(str[l - 1]));
+  unsigned int k = 0;
+  const char *end = str + (l & ~cast(size_t, 3));
+  for (; str < end; str += 4) {
+    memcpy(&k, str, 4);
+    h ^= mixblock(k);
+    h = rotl32(h, 13) * 5 + 0xe6546b64u;
+  }
+  k = 0;
+  switch (l & 3) {  /* last bytes */
+    case 3: k ^= cast(unsigned int, cast_byte(str[2])) << 16;  /* FALLTHROUGH */
+    case 2: k ^= cast(unsigned int, cast_byte(str[1])) << 8;  /* FALLTHROUGH */
+    case 1: k ^= cast_byte(str[0]);
+            h ^= mixblock(k);
+  }
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35u;
+  h ^= h >> 16;
   return h;
 }
 
@@ -65,12 +89,71 @@ unsigned int luaS_hashlongstr (TString *ts) {
 }
 
 
+/*
+** @@FastLua: the string table grows incrementally. When it doubles, the
+** strings of each bucket 'i' of the first half stay there until the
+** bucket is split, moving to bucket 'i + size/2' those that belong
+** there; buckets are split in order, a few for each new string, so
+** 'split' is the first bucket not split yet. Out of a growth, 'split'
+** is equal to 'size'.
+*/
+static int strbucket (const stringtable *tb, unsigned int h) {
+  int i = lmod(h, tb->size);
+  int half = tb->size / 2;
+  if (i >= half && i - half >= tb->split)  /* pair not split yet? */
+    i -= half;
+  return i;
+}
+
+
+static void splitbucket (stringtable *tb) {
+  int half = tb->size / 2;
+  TString **p = &tb->hash[tb->split];
+  TString **q = &tb->hash[tb->split + half];
+  lua_assert(tb->split < half && *q == NULL);
+  while (*p != NULL) {
+    TString *ts = *p;
+    if (lmod(ts->hash, tb->size) != tb->split) {  /* goes to new half? */
+      *p = ts->u.hnext;  /* remove it from this list */
+      ts->u.hnext = *q;  /* and chain it in the other one */
+      *q = ts;
+    }
+    else p = &ts->u.hnext;
+  }
+  if (++tb->split == half)  /* all buckets split? */
+    tb->split = tb->size;  /* growth is over */
+}
+
+
+/*
+** make room for a new string: continue the current growth or start a
+** new one when the table is full
+*/
+static void growstrtab (lua_State *L, stringtable *tb) {
+  if (tb->split < tb->size) {  /* growing? */
+    int n = LUAI_STRSPLITSTEP;
+    while (n-- > 0 && tb->split < tb->size)
+      splitbucket(tb);
+  }
+  else if (tb->nuse >= tb->size && tb->size <= MAX_INT/2) {
+    int i;
+    luaM_reallocvector(L, tb->hash, tb->size, tb->size * 2, TString *);
+    for (i = tb->size; i < tb->size * 2; i++)
+      tb->hash[i] = NULL;
+    tb->size *= 2;
+    tb->split = 0;  /* nothing split yet */
+  }
+}
+
+
 /*
 ** resizes the string table
 */
 void luaS_resize (lua_State *L, int newsize) {
   int i;
   stringtable *tb = &G(L)->strt;
+  while (tb->split < tb->size)  /* @@FastLua: finish current growth */
+    splitbucket(tb);
   if (newsize > tb->size) {  /* grow table if needed */
     luaM_reallocvector(L, tb->hash, tb->size, newsize, TString *);
     for (i = tb->size; i < newsize; i++)
@@ -93,6 +176,7 @@ void luaS_resize (lua_State *L, int newsize) {
     luaM_reallocvector(L, tb->hash, tb->size, newsize, TString *);
   }
   tb->size = newsize;
+  tb->split = newsize;
 }
 
 
@@ -153,7 +237,7 @@ TString *luaS_createlngstrobj (lua_State *L, size_t l) {
 
 void luaS_remove (lua_State *L, TString *ts) {
   stringtable *tb = &G(L)->strt;
-  TString **p = &tb->hash[lmod(ts->hash, tb->size)];
+  TString **p = &tb->hash[strbucket(tb, ts->hash)];
   while (*p != ts)  /* find previous element */
     p = &(*p)->u.hnext;
   *p = (*p)->u.hnext;  /* remove element from its list */
@@ -168,7 +252,7 @@ static TString *internshrstr (lua_State *L, const char *str, size_t l) {
   TString *ts;
   global_State *g = G(L);
   unsigned int h = luaS_hash(str, l, g->seed);
-  TString **list = &g->strt.hash[lmod(h, g->strt.size)];
+  TString **list = &g->strt.hash[strbucket(&g->strt, h)];
   lua_assert(str != NULL);  /* otherwise 'memcmp'/'memcpy' are undefined */
   for (ts = *list; ts != NULL; ts = ts->u.hnext) {
     if (l == ts->shrlen &&
@@ -179,9 +263,9 @@ static TString *internshrstr (lua_State *L, const char *str, size_t l) {
       return ts;
     }
   }
-  if (g->strt.nuse >= g->strt.size && g->strt.size <= MAX_INT/2) {
-    luaS_resize(L, g->strt.size * 2);
-    list = &g->strt.hash[lmod(h, g->strt.size)];  /* recompute with new size */
+  if (g->strt.split < g->strt.size || g->strt.nuse >= g->strt.size) {
+    growstrtab(L, &g->strt);  /* @@FastLua */
+    list = &g->strt.hash[strbucket(&g->strt, h)];  /* recompute */
   }
   ts = createstrobj(L, l, LUA_TSHRSTR, h);
   memcpy(getstr(ts), str, l * sizeof(char));
@@ -604,6 +604,225 @@ static void reprepstate (MatchState *ms) {
 }
 
 
+/*
+** {======================================================
+** @@FastLua: Start filters
+** An unanchored search tries a match at each position of the subject.
+** When every match of the pattern starts with a known literal prefix,
+** or with a character from the set of its first single-char item,
+** 'nextstart' skips right away the positions where no match can start
+** ('memchr'/'lmemfind' for prefixes). Computing a set takes a test for
+** each character, so the sets are kept in a small per-state cache (an
+** upvalue of the pattern functions), keyed by the text of the item.
+** Character classes depend on the ctype locale, so the cache is emptied
+** when LC_CTYPE changes, and filters that outlive a call to Lua code
+** (in 'gmatch' and 'gsub') check it again before they are used.
+** =======================================================
+*/
+
+#define MAXPREFIX	32  /* longest literal prefix used by a filter */
+#define SETCACHESIZE	64  /* number of entries in the cache of sets */
+#define SETKEYMAX	30  /* longest item with a cached set */
+#define CTYPEMAX	32  /* longest LC_CTYPE name that is remembered */
+
+#define setbit(set,c)	((set)[(c) >> 3] |= (1 << ((c) & 7)))
+#define inset(set,c)	((set)[(c) >> 3] & (1 << ((c) & 7)))
+
+
+typedef struct StartFilter {
+  size_t litlen;  /* length of the literal prefix (0 if none) */
+  int hasset;  /* true if 'set' filters the first character */
+  char lit[MAXPREFIX];  /* literal prefix */
+  unsigned char set[32];  /* characters that can start a match */
+  const char *item;  /* single-char item that gave 'set' */
+  const char *itemend;
+  char ctype[CTYPEMAX];  /* LC_CTYPE of 'set' ("" if unknown) */
+} StartFilter;
+
+
+typedef struct SetCache {
+  char ctype[CTYPEMAX];  /* LC_CTYPE of the cached sets */
+  struct {
+    unsigned char len;  /* length of the key (0 for an empty entry) */
+    char key[SETKEYMAX];  /* text of the item */
+    unsigned char set[32];
+  } e[SETCACHESIZE];
+} SetCache;
+
+
+/*
+** End of the single-char item at 'p', or NULL if it is malformed (the
+** error is left to 'match', which may never get there)
+*/
+static const char *itemend (const char *p, const char *p_end) {
+  switch (*p++) {
+    case L_ESC:
+      return (p == p_end) ? NULL : p + 1;
+    case '[': {
+      if (*p == '^') p++;
+      do {  /* look for a ']' */
+        if (p == p_end) return NULL;
+        if (*(p++) == L_ESC && p < p_end)
+          p++;  /* skip escapes (e.g. '%]') */
+      } while (*p != ']');
+      return p + 1;
+    }
+    default:
+      return p;
+  }
+}
+
+
+#define isoptional(ep,p_end)  \
+  ((ep) < (p_end) && (*(ep) == '*' || *(ep) == '?' || *(ep) == '-'))
+
+
+/* copy the name of the current LC_CTYPE to 'name' ("" if too long) */
+static void getctype (char *name) {
+  const char *cur = setlocale(LC_CTYPE, NULL);
+  size_t l = (cur == NULL) ? CTYPEMAX : strlen(cur);
+  if (l < CTYPEMAX)
+    memcpy(name, cur, l + 1);
+  else
+    name[0] = '\0';
+}
+
+
+/* fill 'set' with the characters matched by item [p, ep) */
+static void computeset (const char *p, const char *ep, unsigned char *set) {
+  int c;
+  memset(set, 0, 32);
+  for (c = 0; c <= UCHAR_MAX; c++) {
+    if (*p == L_ESC ? match_class(c, uchar(*(p + 1)))
+                    : matchbracketclass(c, p, ep - 1))
+      setbit(set, c);
+  }
+}
+
+
+/* 'computeset' through the cache; 'ctype' is the current LC_CTYPE */
+static void itemset (SetCache *cache, const char *p, const char *ep,
+                     unsigned char *set, const char *ctype) {
+  size_t l = ep - p;
+  unsigned int h = 2166136261u;
+  size_t i;
+  if (ctype[0] == '\0' || l > SETKEYMAX) {  /* cannot use the cache? */
+    computeset(p, ep, set);
+    return;
+  }
+  if (strcmp(cache->ctype, ctype) != 0) {  /* locale changed? */
+    memset(cache->e, 0, sizeof(cache->e));  /* all sets are stale */
+    strcpy(cache->ctype, ctype);
+  }
+  for (i = 0; i < l; i++)
+    h = (h ^ uchar(p[i])) * 16777619u;
+  h %= SETCACHESIZE;
+  if (cache->e[h].len == l && memcmp(cache->e[h].key, p, l) == 0) {
+    memcpy(set, cache->e[h].set, 32);  /* cached */
+    return;
+  }
+  computeset(p, ep, set);
+  cache->e[h].len = (unsigned char)l;  /* keep it */
+  memcpy(cache->e[h].key, p, l);
+  memcpy(cache->e[h].set, set, 32);
+}
+
+
+static void prepfilter (StartFilter *sf, SetCache *cache,
+                        const char *p, const char *p_end) {
+  const char *ep;
+  int ncap = 0;
+  sf->litlen = 0;
+  sf->hasset = 0;
+  /* captures do not consume characters */
+  while (p < p_end && *p == '(' && ++ncap < LUA_MAXCAPTURES)
+    p += (p + 1 < p_end && *(p + 1) == ')') ? 2 : 1;
+  while (p < p_end && sf->litlen < MAXPREFIX) {  /* collect literal prefix */
+    int c;
+    if (*p == L_ESC) {
+      if (p + 1 == p_end || isalnum(uchar(*(p + 1))))
+        break;  /* class, '%b', '%f' or back reference */
+      c = uchar(*(p + 1));
+      ep = p + 2;
+    }
+    else if (*p == '(' || *p == ')' || *p == '.' || *p == '[' ||
+             (*p == '$' && p + 1 == p_end))
+      break;
+    else {
+      c = uchar(*p);
+      ep = p + 1;
+    }
+    if (isoptional(ep, p_end))
+      break;
+    sf->lit[sf->litlen++] = (char)c;
+    if (ep < p_end && *ep == '+')
+      break;
+    p = ep;
+  }
+  if (sf->litlen > 0 || p == p_end || (*p != L_ESC && *p != '['))
+    return;
+  if (*p == L_ESC && *(p + 1) == 'b') {  /* balance starts with its 'x' */
+    if (p + 4 <= p_end) {  /* else let 'match' raise the error */
+      sf->lit[0] = *(p + 2);
+      sf->litlen = 1;
+    }
+    return;
+  }
+  if (*p == L_ESC && (*(p + 1) == 'f' || isdigit(uchar(*(p + 1)))))
+    return;  /* frontier or back reference */
+  ep = itemend(p, p_end);
+  if (ep != NULL && !isoptional(ep, p_end)) {
+    getctype(sf->ctype);
+    itemset(cache, p, ep, sf->set, sf->ctype);
+    sf->item = p;
+    sf->itemend = ep;
+    sf->hasset = 1;
+  }
+}
+
+
+/* recompute the set of 'sf' if LC_CTYPE may have changed since 'prepfilter' */
+static void checkfilter (StartFilter *sf) {
+  if (sf->hasset) {
+    char ctype[CTYPEMAX];
+    getctype(ctype);
+    if (ctype[0] == '\0' || strcmp(ctype, sf->ctype) != 0) {
+      computeset(sf->item, sf->itemend, sf->set);
+      strcpy(sf->ctype, ctype);
+    }
+  }
+}
+
+
+/*
+** First position in [s, e) where a match may start, or NULL if there
+** is none. (A match found by a filter is never empty, so position 'e'
+** is never needed.)
+*/
+static const char *nextstart (const StartFilter *sf, const char *s,
+                              const char *e) {
+  if (sf->litlen == 1)
+    return (const char *)memchr(s, uchar(sf->lit[0]), e - s);
+  else if (sf->litlen > 1)
+    return lmemfind(s, e - s, sf->lit, sf->litlen);
+  else if (sf->hasset) {
+    for (; s < e; s++) {
+      if (inset(sf->set, uchar(*s)))
+        return s;
+    }
+    return NULL;
+  }
+  else
+    return s;  /* no filter */
+}
+
+
+#define getsetcache(L)	((SetCache *)lua_touserdata(L, lua_upvalueindex(1)))
+
+/* }====================================================== */
+
+
+
 static int str_find_aux (lua_State *L, int find) {
   size_t ls, lp;
   const char *s = luaL_checklstring(L, 1, &ls);
@@ -626,14 +845,19 @@ static int str_find_aux (lua_State *L, int find) {
   }
   else {
     MatchState ms;
+    StartFilter sf;
     const char *s1 = s + init - 1;
     int anchor = (*p == '^');
     if (anchor) {
       p++; lp--;  /* skip anchor character */
     }
     prepstate(&ms, L, s, ls, p, lp);
+    if (!anchor)  /* @@FastLua */
+      prepfilter(&sf, getsetcache(L), p, p + lp);
     do {
       const char *res;
+      if (!anchor && (s1 = nextstart(&sf, s1, ms.src_end)) == NULL)
+        break;  /* no more places where a match can start */
       reprepstate(&ms);
       if ((res=match(&ms, s1, p)) != NULL) {
         if (find) {
@@ -667,6 +891,7 @@ typedef struct GMatchState {
   const char *p;  /* pattern */
   const char *lastmatch;  /* end of last match */
   MatchState ms;  /* match state */
+  StartFilter sf;  /* @@FastLua: where matches can start */
 } GMatchState;
 
 
@@ -674,8 +899,11 @@ static int gmatch_aux (lua_State *L) {
   GMatchState *gm = (GMatchState *)lua_touserdata(L, lua_upvalueindex(3));
   const char *src;
   gm->ms.L = L;
+  checkfilter(&gm->sf);  /* @@FastLua: the locale may have changed */
   for (src = gm->src; src <= gm->ms.src_end; src++) {
     const char *e;
+    if ((src = nextstart(&gm->sf, src, gm->ms.src_end)) == NULL)
+      break;  /* @@FastLua: no more places where a match can start */
     reprepstate(&gm->ms);
     if ((e = match(&gm->ms, src, gm->p)) != NULL && e != gm->lastmatch) {
       gm->src = gm->lastmatch = e;
@@ -694,6 +922,7 @@ static int gmatch (lua_State *L) {
   lua_settop(L, 2);  /* keep them on closure to avoid being collected */
   gm = (GMatchState *)lua_newuserdata(L, sizeof(GMatchState));
   prepstate(&gm->ms, L, s, ls, p, lp);
+  prepfilter(&gm->sf, getsetcache(L), p, p + lp);  /* @@FastLua */
   gm->src = s; gm->p = p; gm->lastmatch = NULL;
   lua_pushcclosure(L, gmatch_aux, 3);
   return 1;
@@ -769,6 +998,7 @@ static int str_gsub (lua_State *L) {
   int anchor = (*p == '^');
   lua_Integer n = 0;  /* replacement count */
   MatchState ms;
+  StartFilter sf;
   luaL_Buffer b;
   luaL_argcheck(L, tr == LUA_TNUMBER || tr == LUA_TSTRING ||
                    tr == LUA_TFUNCTION || tr == LUA_TTABLE, 3,
@@ -778,13 +1008,23 @@ static int str_gsub (lua_State *L) {
     p++; lp--;  /* skip anchor character */
   }
   prepstate(&ms, L, src, srcl, p, lp);
+  if (!anchor)  /* @@FastLua */
+    prepfilter(&sf, getsetcache(L), p, p + lp);
   while (n < max_s) {
     const char *e;
+    if (!anchor) {  /* @@FastLua: copy what cannot start a match */
+      const char *s1 = nextstart(&sf, src, ms.src_end);
+      if (s1 == NULL) break;  /* rest of the subject is copied below */
+      luaL_addlstring(&b, src, s1 - src);
+      src = s1;
+    }
     reprepstate(&ms);  /* (re)prepare state for new match */
     if ((e = match(&ms, src, p)) != NULL && e != lastmatch) {  /* match? */
       n++;
       add_value(&ms, &b, src, e, tr);  /* add replacement to buffer */
       src = lastmatch = e;
+      if (!anchor && (tr == LUA_TFUNCTION || tr == LUA_TTABLE))
+        checkfilter(&sf);  /* @@FastLua: Lua code may change the locale */
     }
     else if (src < ms.src_end)  /* otherwise, skip one character */
       luaL_addchar(&b, *src++);
@@ -1012,22 +1252,23 @@ static void addlenmod (char *form, const char *lenmod) {
 }
 
 
-static int str_format (lua_State *L) {
+/*
+** Add to 'b' the format at index 'arg' applied to the values after it.
+** 'b' must have been just initialized.
+*/
+static void addformat (lua_State *L, luaL_Buffer *b, int arg) {
   int top = lua_gettop(L);
-  int arg = 1;
   size_t sfl;
   const char *strfrmt = luaL_checklstring(L, arg, &sfl);
   const char *strfrmt_end = strfrmt+sfl;
-  luaL_Buffer b;
-  luaL_buffinit(L, &b);
   while (strfrmt < strfrmt_end) {
     if (*strfrmt != L_ESC)
-      luaL_addchar(&b, *strfrmt++);
+      luaL_addchar(b, *strfrmt++);
     else if (*++strfrmt == L_ESC)
-      luaL_addchar(&b, *strfrmt++);  /* %% */
+      luaL_addchar(b, *strfrmt++);  /* %% */
     else { /* format item */
       char form[MAX_FORMAT];  /* to store the format ('%...') */
-      char *buff = luaL_prepbuffsize(&b, MAX_ITEM);  /* to put formatted item */
+      char *buff = luaL_prepbuffsize(b, MAX_ITEM);  /* to put formatted item */
       int nb = 0;  /* number of bytes in added item */
       if (++arg > top)
         luaL_argerror(L, arg, "no value");
@@ -1056,19 +1297,19 @@ static int str_format (lua_State *L) {
           break;
         }
         case 'q': {
-          addliteral(L, &b, arg);
+          addliteral(L, b, arg);
           break;
         }
         case 's': {
           size_t l;
           const char *s = luaL_tolstring(L, arg, &l);
           if (form[2] == '\0')  /* no modifiers? */
-            luaL_addvalue(&b);  /* keep entire string */
+            luaL_addvalue(b);  /* keep entire string */
           else {
             luaL_argcheck(L, l == strlen(s), arg, "string contains zeros");
             if (!strchr(form, '.') && l >= 100) {
               /* no precision and string is too long to be formatted */
-              luaL_addvalue(&b);  /* keep entire string */
+              luaL_addvalue(b);  /* keep entire string */
             }
             else {  /* format the string into 'buff' */
               nb = l_sprintf(buff, MAX_ITEM, form, s);
@@ -1078,14 +1319,21 @@ static int str_format (lua_State *L) {
           break;
         }
         default: {  /* also treat cases 'pnLlh' */
-          return luaL_error(L, "invalid option '%%%c' to 'format'",
-                               *(strfrmt - 1));
+          luaL_error(L, "invalid option '%%%c' to 'format'",
+                        *(strfrmt - 1));
         }
       }
       lua_assert(nb < MAX_ITEM);
-      luaL_addsize(&b, nb);
+      luaL_addsize(b, nb);
     }
   }
+}
+
+
+static int str_format (lua_State *L) {
+  luaL_Buffer b;
+  luaL_buffinit(L, &b);
+  addformat(L, &b, 1);
   luaL_pushresult(&b);
   return 1;
 }
@@ -1093,6 +1341,162 @@ static int str_format (lua_State *L) {
 /* }====================================================== */
 
 
+/*
+** {======================================================
+** @@FastLua: String buffers
+** A 'string.buffer' keeps its contents in a block of its own, which
+** grows by doubling, so appending costs no intermediate strings; only
+** 'tostring' creates one. The block is a full userdata stored as the
+** user value of the buffer, so the collector accounts for it.
+** =======================================================
+*/
+
+#define STRBUFFER	"string.buffer"
+
+#define MINSTRBUF	64  /* smallest block of a buffer */
+
+#define tostrbuf(L)	((StrBuf *)luaL_checkudata(L, 1, STRBUFFER))
+
+
+typedef struct StrBuf {
+  char *b;  /* contents (the user value of the buffer) */
+  size_t n;  /* number of characters in buffer */
+  size_t size;  /* size of block 'b' */
+} StrBuf;
+
+
+/* move the contents of buffer at index 'idx' to a new block */
+static void resizestrbuf (lua_State *L, int idx, StrBuf *sb, size_t newsize) {
+  char *newb = (char *)lua_newuserdata(L, newsize);
+  if (sb->n > 0)
+    memcpy(newb, sb->b, sb->n);
+  lua_setuservalue(L, idx);  /* old block is now garbage */
+  sb->b = newb;
+  sb->size = newsize;
+}
+
+
+/* add to the buffer at index 1 */
+static void addtostrbuf (lua_State *L, StrBuf *sb, const char *s, size_t l) {
+  if (sb->size - sb->n < l) {  /* not enough space? */
+    size_t newsize = sb->size * 2;  /* double buffer size */
+    if (newsize - sb->n < l) {  /* not big enough? */
+      if (l > MAXSIZE - sb->n)
+        luaL_error(L, "buffer too large");
+      newsize = sb->n + l;
+    }
+    if (newsize < MINSTRBUF)
+      newsize = MINSTRBUF;
+    resizestrbuf(L, 1, sb, newsize);
+  }
+  memcpy(sb->b + sb->n, s, l);
+  sb->n += l;
+}
+
+
+static int str_buffer (lua_State *L) {
+  lua_Integer size = luaL_optinteger(L, 1, 0);
+  StrBuf *sb;
+  luaL_argcheck(L, 0 <= size && (lua_Unsigned)size <= MAXSIZE, 1,
+                   "invalid size");
+  sb = (StrBuf *)lua_newuserdata(L, sizeof(StrBuf));
+  sb->b = NULL;
+  sb->n = sb->size = 0;
+  luaL_setmetatable(L, STRBUFFER);
+  if (size > 0)
+    resizestrbuf(L, lua_gettop(L), sb, (size_t)size);
+  return 1;
+}
+
+
+/*
+** Appends strings and numbers to the buffer. Numbers are written as
+** 'tostring' would write them, but without creating a string.
+*/
+static int strbuf_put (lua_State *L) {
+  StrBuf *sb = tostrbuf(L);
+  int top = lua_gettop(L);
+  int i;
+  for (i = 2; i <= top; i++) {
+    if (lua_type(L, i) == LUA_TNUMBER) {
+      char buff[MAX_ITEM];
+      int len;
+      if (lua_isinteger(L, i))
+        len = lua_integer2str(buff, sizeof(buff), lua_tointeger(L, i));
+      else {
+        len = lua_number2str(buff, sizeof(buff), lua_tonumber(L, i));
+        if (buff[strspn(buff, "-0123456789")] == '\0') {  /* looks like an int? */
+          buff[len++] = lua_getlocaledecpoint();
+          buff[len++] = '0';  /* adds '.0' to result */
+        }
+      }
+      addtostrbuf(L, sb, buff, len);
+    }
+    else {
+      size_t l;
+      const char *s = luaL_checklstring(L, i, &l);
+      addtostrbuf(L, sb, s, l);
+    }
+  }
+  lua_settop(L, 1);
+  return 1;  /* return buffer */
+}
+
+
+static int strbuf_putf (lua_State *L) {
+  StrBuf *sb = tostrbuf(L);
+  luaL_Buffer b;
+  luaL_buffinit(L, &b);
+  addformat(L, &b, 2);
+  addtostrbuf(L, sb, b.b, b.n);
+  lua_settop(L, 1);
+  return 1;  /* return buffer */
+}
+
+
+static int strbuf_reset (lua_State *L) {
+  StrBuf *sb = tostrbuf(L);
+  sb->n = 0;  /* keep the block for reuse */
+  lua_settop(L, 1);
+  return 1;  /* return buffer */
+}
+
+
+static int strbuf_tostring (lua_State *L) {
+  StrBuf *sb = tostrbuf(L);
+  lua_pushlstring(L, sb->b, sb->n);
+  return 1;
+}
+
+
+static int strbuf_len (lua_State *L) {
+  lua_pushinteger(L, (lua_Integer)tostrbuf(L)->n);
+  return 1;
+}
+
+
+static const luaL_Reg strbuf_methods[] = {
+  {"put", strbuf_put},
+  {"putf", strbuf_putf},
+  {"reset", strbuf_reset},
+  {"tostring", strbuf_tostring},
+  {"__len", strbuf_len},
+  {"__tostring", strbuf_tostring},
+  {NULL, NULL}
+};
+
+
+static void createbuffermeta (lua_State *L) {
+  luaL_newmetatable(L, STRBUFFER);
+  luaL_setfuncs(L, strbuf_methods, 0);
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -2, "__index");  /* metatable.__index = metatable */
+  lua_pop(L, 1);  /* pop metatable */
+}
+
+/* }====================================================== */
+
+
 /*
 ** {======================================================
 ** PACK/UNPACK
@@ -1538,16 +1942,13 @@ static int str_unpack (lua_State *L) {
 
 
 static const luaL_Reg strlib[] = {
+  {"buffer", str_buffer},
   {"byte", str_byte},
   {"char", str_char},
   {"dump", str_dump},
-  {"find", str_find},
   {"format", str_format},
-  {"gmatch", gmatch},
-  {"gsub", str_gsub},
   {"len", str_len},
   {"lower", str_lower},
-  {"match", str_match},
   {"rep", str_rep},
   {"reverse", str_reverse},
   {"sub", str_sub},
@@ -1559,6 +1960,16 @@ static const luaL_Reg strlib[] = {
 };
 
 
+/* @@FastLua: pattern functions, sharing the cache of start sets */
+static const luaL_Reg patlib[] = {
+  {"find", str_find},
+  {"gmatch", gmatch},
+  {"gsub", str_gsub},
+  {"match", str_match},
+  {NULL, NULL}
+};
+
+
 static void createmetatable (lua_State *L) {
   lua_createtable(L, 0, 1);  /* table to be metatable for strings */
   lua_pushliteral(L, "");  /* dummy string */
@@ -1571,12 +1982,23 @@ static void createmetatable (lua_State *L) {
 }
 
 
+#ifdef FL_ENABLE
+/* functions with fast paths in the FastLua traces */
+LUAI_DDEF const lua_CFunction flstr_byte = str_byte;
+LUAI_DDEF const lua_CFunction flstr_sub = str_sub;
+LUAI_DDEF const lua_CFunction flstr_char = str_char;
+#endif
+
+
 /*
 ** Open string library
 */
 LUAMOD_API int luaopen_string (lua_State *L) {
   luaL_newlib(L, strlib);
+  memset(lua_newuserdata(L, sizeof(SetCache)), 0, sizeof(SetCache));
+  luaL_setfuncs(L, patlib, 1);  /* @@FastLua */
   createmetatable(L);
+  createbuffermeta(L);  /* @@FastLua */
   return 1;
 }
 
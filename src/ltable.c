@@ -21,10 +21,12 @@
 ** in its main position (i.e. the 'original' position that its hash gives
 ** to it), then the colliding element is in its own main position.
 ** Hence even when the load factor reaches 100%, performance remains good.
+** (@@FastLua: LUA_USE_SWISSTABLE replaces the chains by group probing.)
 */
 
 #include <math.h>
 #include <limits.h>
+#include <string.h>
 
 #include "lua.h"
 
@@ -112,6 +114,10 @@ static int l_hashfloat (lua_Number n) {
 #endif
 
 
+#if !defined(LUA_USE_SWISSTABLE)	/* { */
+
+#define freenodes(L,n,size)	luaM_freearray(L, n, cast(size_t, size))
+
 /*
 ** returns the 'main' position of an element in a table (that is, the index
 ** of its hash value)
@@ -138,6 +144,178 @@ static Node *mainposition (const Table *t, const TValue *key) {
   }
 }
 
+#else				/* }{ */
+
+/*
+** {=============================================================
+** @@FastLua: group-probed hash part
+** Each node has a control byte: EMPTY for free positions or the 7 high
+** bits of the (mixed) hash of its key. A search compares the control
+** bytes of a group of GROUPSIZE positions at once and only looks at the
+** keys whose bytes match. The low bits of the hash choose the first group
+** and the next ones follow a triangular sequence, which visits all of
+** them. As with the chains, keys are only removed by a rehash (a removed
+** entry just has a nil value), so a group with an EMPTY position ends a
+** search. Hash parts smaller than a group pad their control bytes with
+** PADDING, which matches nothing. Nodes and control bytes are allocated
+** in the same block.
+** ==============================================================
+*/
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define GROUPSIZE	16
+#define EMPTY		0x80
+#define PADDING		0xFE
+
+#define numgroups(t)	cast(unsigned int, (sizenode(t) + GROUPSIZE - 1) / GROUPSIZE)
+#define ctrlsize(size)	((size) < GROUPSIZE ? GROUPSIZE : (size))
+#define ctrlbyte(h)	cast_byte((h) >> 25)
+
+/* number of keys that fit in a hash part with 'size' positions */
+#define maxgrowth(size)	((size) <= GROUPSIZE ? (size) : (size) - (size) / 8)
+
+#define nodebytes(size)	(cast(size_t, size) * sizeof(Node) + ctrlsize(size))
+#define freenodes(L,n,size)	luaM_freemem(L, n, nodebytes(size))
+
+static const lu_byte dummyctrl[GROUPSIZE] = {
+  EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY,
+  EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY
+};
+
+
+/* bit mask of the positions of a group whose control byte is 'b' */
+#if defined(__SSE2__)
+static unsigned int matchbyte (const lu_byte *group, int b) {
+  __m128i ctrl = _mm_loadu_si128(cast(const __m128i *, group));
+  __m128i eq = _mm_cmpeq_epi8(ctrl, _mm_set1_epi8(cast(char, b)));
+  return cast(unsigned int, _mm_movemask_epi8(eq));
+}
+#else
+static unsigned int matchbyte (const lu_byte *group, int b) {
+  unsigned int m = 0;
+  int i;
+  for (i = 0; i < GROUPSIZE; i++)
+    if (group[i] == b) m |= 1u << i;
+  return m;
+}
+#endif
+
+
+#if defined(__GNUC__)
+#define firstbit(m)	__builtin_ctz(m)
+#else
+static int firstbit (unsigned int m) {
+  int i = 0;
+  while (!(m & 1)) { m >>= 1; i++; }
+  return i;
+}
+#endif
+
+
+/* spread the bits of a hash (finalizer of MurmurHash3) */
+static unsigned int mixhash (unsigned int h) {
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35u;
+  h ^= h >> 16;
+  return h;
+}
+
+
+#define mixint(i) \
+	mixhash(cast(unsigned int, l_castS2U(i) ^ (l_castS2U(i) >> 31 >> 1)))
+
+
+static unsigned int hashkey (const TValue *key) {
+  switch (ttype(key)) {
+    case LUA_TNUMINT:
+      return mixint(ivalue(key));
+    case LUA_TNUMFLT:
+      return mixhash(cast(unsigned int, l_hashfloat(fltvalue(key))));
+    case LUA_TSHRSTR:
+      return mixhash(tsvalue(key)->hash);
+    case LUA_TLNGSTR:
+      return mixhash(luaS_hashlongstr(tsvalue(key)));
+    case LUA_TBOOLEAN:
+      return mixhash(cast(unsigned int, bvalue(key)));
+    case LUA_TLIGHTUSERDATA:
+      return mixhash(point2uint(pvalue(key)));
+    case LUA_TLCF:
+      return mixhash(point2uint(fvalue(key)));
+    default:
+      lua_assert(!ttisdeadkey(key));
+      return mixhash(point2uint(gcvalue(key)));
+  }
+}
+
+
+/*
+** Visit in probe order the nodes whose control bytes match the hash 'h',
+** until the key 'k' of one of them satisfies 'cond'; 'n' gets that node
+** or NULL.
+*/
+#define probe(t,h,n,k,cond) { \
+  unsigned int gmask_ = numgroups(t) - 1; \
+  unsigned int g_ = (h) & gmask_; \
+  unsigned int i_; \
+  n = NULL; \
+  for (i_ = 0; i_ <= gmask_; i_++) { \
+    const lu_byte *ctrl_ = (t)->ctrl + g_ * GROUPSIZE; \
+    unsigned int m_; \
+    for (m_ = matchbyte(ctrl_, ctrlbyte(h)); m_ != 0; m_ &= m_ - 1) { \
+      Node *c_ = gnode(t, g_ * GROUPSIZE + firstbit(m_)); \
+      const TValue *k = gkey(c_); \
+      if (cond) { n = c_; break; } \
+    } \
+    if (n != NULL || matchbyte(ctrl_, EMPTY) != 0) break; \
+    g_ = (g_ + i_ + 1) & gmask_; \
+  } }
+
+
+/* take a free position for a new key with hash 'h' */
+static Node *newslot (Table *t, unsigned int h) {
+  unsigned int gmask = numgroups(t) - 1;
+  unsigned int g = h & gmask;
+  unsigned int i;
+  lua_assert(t->growth > 0);
+  for (i = 0; ; i++) {
+    lu_byte *ctrl = t->ctrl + g * GROUPSIZE;
+    unsigned int m = matchbyte(ctrl, EMPTY);
+    if (m != 0) {
+      int pos = firstbit(m);
+      ctrl[pos] = ctrlbyte(h);
+      t->growth--;
+      return gnode(t, g * GROUPSIZE + pos);
+    }
+    lua_assert(i < gmask);
+    g = (g + i + 1) & gmask;
+  }
+}
+
+
+/* make all positions of the hash part free */
+static void clearnodes (Table *t) {
+  int size = sizenode(t);
+  int i;
+  for (i = 0; i < size; i++) {
+    Node *n = gnode(t, i);
+    gnext(n) = 0;
+    setnilvalue(wgkey(n));
+    setnilvalue(gval(n));
+  }
+  memset(t->ctrl, EMPTY, size);
+  memset(t->ctrl + size, PADDING, ctrlsize(size) - size);
+  t->growth = maxgrowth(size);
+}
+
+/* }============================================================= */
+
+#endif				/* } */
+
 
 /*
 ** returns the index for 'key' if 'key' is an appropriate key to live in
@@ -164,6 +342,7 @@ static unsigned int findindex (lua_State *L, Table *t, StkId key) {
   i = arrayindex(key);
   if (i != 0 && i <= t->sizearray)  /* is 'key' inside array part? */
     return i;  /* yes; that's the index */
+#if !defined(LUA_USE_SWISSTABLE)
   else {
     int nx;
     Node *n = mainposition(t, key);
@@ -182,9 +361,36 @@ static unsigned int findindex (lua_State *L, Table *t, StkId key) {
       else n += nx;
     }
   }
+#else
+  else {
+    Node *n;
+    unsigned int h = hashkey(key);
+    probe(t, h, n, k, luaV_rawequalobj(k, key));
+    if (n == NULL && iscollectable(key)) {
+      /* key may be dead already, but it is ok to use it in 'next' (a dead
+         copy of a key is searched only after a live one, which follows it) */
+      probe(t, h, n, k, ttisdeadkey(k) && deadvalue(k) == gcvalue(key));
+    }
+    if (n == NULL)
+      luaG_runerror(L, "invalid key to 'next'");  /* key not found */
+    i = cast_int(n - gnode(t, 0));  /* key index in hash table */
+    /* hash elements are numbered after array ones */
+    return (i + 1) + t->sizearray;
+  }
+#endif
 }
 
 
+#ifdef FL_ENABLE
+/*
+** @@FastLua: position of 'key' in the traversal order of 'luaH_next'
+*/
+unsigned int luaH_findindex (lua_State *L, Table *t, StkId key) {
+  return findindex(L, t, key);
+}
+#endif
+
+
 int luaH_next (lua_State *L, Table *t, StkId key) {
   unsigned int i = findindex(L, t, key);  /* find original element */
   for (; i < t->sizearray; i++) {  /* try first array part */
@@ -307,6 +513,8 @@ static void setarrayvector (lua_State *L, Table *t, unsigned int size) {
 }
 
 
+#if !defined(LUA_USE_SWISSTABLE)
+
 static void setnodevector (lua_State *L, Table *t, unsigned int size) {
   int lsize;
   if (size == 0) {  /* no elements to hash part? */
@@ -331,6 +539,39 @@ static void setnodevector (lua_State *L, Table *t, unsigned int size) {
   t->lastfree = gnode(t, size);  /* all positions are free */
 }
 
+#define maxkeys(t)	(isdummy((t)->node) ? 0 : sizenode(t))
+
+#else
+
+/*
+** The hash part gets the smallest power of 2 of positions that holds
+** 'size' keys.
+*/
+static void setnodevector (lua_State *L, Table *t, unsigned int size) {
+  if (size == 0) {  /* no elements to hash part? */
+    t->node = cast(Node *, dummynode);  /* use common 'dummynode' */
+    t->ctrl = cast(lu_byte *, dummyctrl);
+    t->lsizenode = 0;
+    t->growth = 0;  /* first insertion must rehash */
+  }
+  else {
+    int lsize = luaO_ceillog2(size);
+    if (maxgrowth(twoto(lsize)) < cast_int(size))
+      lsize++;
+    if (lsize > MAXHBITS)
+      luaG_runerror(L, "table overflow");
+    size = twoto(lsize);
+    t->node = cast(Node *, luaM_newvector(L, nodebytes(size), char));
+    t->ctrl = cast(lu_byte *, t->node + size);
+    t->lsizenode = cast_byte(lsize);
+    clearnodes(t);
+  }
+}
+
+#define maxkeys(t)	(isdummy((t)->node) ? 0 : maxgrowth(sizenode(t)))
+
+#endif
+
 
 void luaH_resize (lua_State *L, Table *t, unsigned int nasize,
                                           unsigned int nhsize) {
@@ -363,12 +604,12 @@ void luaH_resize (lua_State *L, Table *t, unsigned int nasize,
     }
   }
   if (!isdummy(nold))
-    luaM_freearray(L, nold, cast(size_t, twoto(oldhsize))); /* free old hash */
+    freenodes(L, nold, twoto(oldhsize));  /* free old hash */
 }
 
 
 void luaH_resizearray (lua_State *L, Table *t, unsigned int nasize) {
-  int nsize = isdummy(t->node) ? 0 : sizenode(t);
+  int nsize = maxkeys(t);
   luaH_resize(L, t, nasize, nsize);
 }
 
@@ -413,14 +654,41 @@ Table *luaH_new (lua_State *L) {
 }
 
 
+/*
+** @@FastLua: remove all entries of the table, keeping its parts allocated
+*/
+void luaH_clear (Table *t) {
+  unsigned int i;
+  for (i = 0; i < t->sizearray; i++)
+    setnilvalue(&t->array[i]);
+  if (!isdummy(t->node)) {
+#if !defined(LUA_USE_SWISSTABLE)
+    int size = sizenode(t);
+    int j;
+    for (j = 0; j < size; j++) {
+      Node *n = gnode(t, j);
+      gnext(n) = 0;
+      setnilvalue(wgkey(n));
+      setnilvalue(gval(n));
+    }
+    t->lastfree = gnode(t, size);  /* all positions are free */
+#else
+    clearnodes(t);
+#endif
+  }
+}
+
+
 void luaH_free (lua_State *L, Table *t) {
   if (!isdummy(t->node))
-    luaM_freearray(L, t->node, cast(size_t, sizenode(t)));
+    freenodes(L, t->node, sizenode(t));
   luaM_freearray(L, t->array, t->sizearray);
   luaM_free(L, t);
 }
 
 
+#if !defined(LUA_USE_SWISSTABLE)
+
 static Node *getfreepos (Table *t) {
   while (t->lastfree > t->node) {
     t->lastfree--;
@@ -490,6 +758,39 @@ TValue *luaH_newkey (lua_State *L, Table *t, const TValue *key) {
   return gval(mp);
 }
 
+#else
+
+/*
+** inserts a new key into a hash table, in the first free position of its
+** probe sequence; rehash first when the table has no room for it.
+*/
+TValue *luaH_newkey (lua_State *L, Table *t, const TValue *key) {
+  Node *mp;
+  TValue aux;
+  if (ttisnil(key)) luaG_runerror(L, "table index is nil");
+  else if (ttisfloat(key)) {
+    lua_Integer k;
+    if (luaV_tointeger(key, &k, 0)) {  /* index is int? */
+      setivalue(&aux, k);
+      key = &aux;  /* insert it as an integer */
+    }
+    else if (luai_numisnan(fltvalue(key)))
+      luaG_runerror(L, "table index is NaN");
+  }
+  if (t->growth == 0) {  /* no room for the new key? */
+    rehash(L, t, key);  /* grow table */
+    /* whatever called 'newkey' takes care of TM cache */
+    return luaH_set(L, t, key);  /* insert key into grown table */
+  }
+  mp = newslot(t, hashkey(key));
+  setnodekey(L, &mp->i_key, key);
+  luaC_barrierback(L, t, key);
+  lua_assert(ttisnil(gval(mp)));
+  return gval(mp);
+}
+
+#endif
+
 
 /*
 ** search function for integers
@@ -498,6 +799,7 @@ const TValue *luaH_getint (Table *t, lua_Integer key) {
   /* (1 <= key && key <= t->sizearray) */
   if (l_castS2U(key) - 1 < t->sizearray)
     return &t->array[key - 1];
+#if !defined(LUA_USE_SWISSTABLE)
   else {
     Node *n = hashint(t, key);
     for (;;) {  /* check whether 'key' is somewhere in the chain */
@@ -511,6 +813,13 @@ const TValue *luaH_getint (Table *t, lua_Integer key) {
     }
     return luaO_nilobject;
   }
+#else
+  else {
+    Node *n;
+    probe(t, mixint(key), n, k, ttisinteger(k) && ivalue(k) == key);
+    return (n != NULL) ? gval(n) : luaO_nilobject;
+  }
+#endif
 }
 
 
@@ -518,6 +827,7 @@ const TValue *luaH_getint (Table *t, lua_Integer key) {
 ** search function for short strings
 */
 const TValue *luaH_getshortstr (Table *t, TString *key) {
+#if !defined(LUA_USE_SWISSTABLE)
   Node *n = hashstr(t, key);
   lua_assert(key->tt == LUA_TSHRSTR);
   for (;;) {  /* check whether 'key' is somewhere in the chain */
@@ -531,6 +841,13 @@ const TValue *luaH_getshortstr (Table *t, TString *key) {
       n += nx;
     }
   }
+#else
+  Node *n;
+  lua_assert(key->tt == LUA_TSHRSTR);
+  probe(t, mixhash(key->hash), n, k,
+        ttisshrstring(k) && eqshrstr(tsvalue(k), key));
+  return (n != NULL) ? gval(n) : luaO_nilobject;
+#endif
 }
 
 
@@ -539,6 +856,7 @@ const TValue *luaH_getshortstr (Table *t, TString *key) {
 ** which may be in array part, nor for floats with integral values.)
 */
 static const TValue *getgeneric (Table *t, const TValue *key) {
+#if !defined(LUA_USE_SWISSTABLE)
   Node *n = mainposition(t, key);
   for (;;) {  /* check whether 'key' is somewhere in the chain */
     if (luaV_rawequalobj(gkey(n), key))
@@ -550,6 +868,11 @@ static const TValue *getgeneric (Table *t, const TValue *key) {
       n += nx;
     }
   }
+#else
+  Node *n;
+  probe(t, hashkey(key), n, k, luaV_rawequalobj(k, key));
+  return (n != NULL) ? gval(n) : luaO_nilobject;
+#endif
 }
 
 
@@ -661,7 +984,11 @@ int luaH_getn (Table *t) {
 #if defined(LUA_DEBUG)
 
 Node *luaH_mainposition (const Table *t, const TValue *key) {
+#if !defined(LUA_USE_SWISSTABLE)
   return mainposition(t, key);
+#else
+  return gnode(t, (hashkey(key) & (numgroups(t) - 1)) * GROUPSIZE);
+#endif
 }
 
 int luaH_isdummy (Node *n) { return isdummy(n); }
@@ -44,8 +44,12 @@ LUAI_FUNC Table *luaH_new (lua_State *L);
 LUAI_FUNC void luaH_resize (lua_State *L, Table *t, unsigned int nasize,
                                                     unsigned int nhsize);
 LUAI_FUNC void luaH_resizearray (lua_State *L, Table *t, unsigned int nasize);
+LUAI_FUNC void luaH_clear (Table *t);
 LUAI_FUNC void luaH_free (lua_State *L, Table *t);
 LUAI_FUNC int luaH_next (lua_State *L, Table *t, StkId key);
+#ifdef FL_ENABLE
+LUAI_FUNC unsigned int luaH_findindex (lua_State *L, Table *t, StkId key);
+#endif
 LUAI_FUNC int luaH_getn (Table *t);
 
 
@@ -423,6 +423,28 @@ static int sort (lua_State *L) {
 /* }====================================================== */
 
 
+/*
+** @@FastLua: 'table.new' creates a table with preallocated parts and
+** 'table.clear' (raw) removes all entries of a table, keeping its parts,
+** so tables with the same shape can be built without rehashes.
+*/
+static int tnew (lua_State *L) {
+  lua_Integer narr = luaL_optinteger(L, 1, 0);
+  lua_Integer nrec = luaL_optinteger(L, 2, 0);
+  luaL_argcheck(L, 0 <= narr && narr <= INT_MAX, 1, "out of range");
+  luaL_argcheck(L, 0 <= nrec && nrec <= INT_MAX, 2, "out of range");
+  lua_createtable(L, (int)narr, (int)nrec);
+  return 1;
+}
+
+
+static int tclear (lua_State *L) {
+  luaL_checktype(L, 1, LUA_TTABLE);
+  lua_cleartable(L, 1);
+  return 0;
+}
+
+
 static const luaL_Reg tab_funcs[] = {
   {"concat", tconcat},
 #if defined(LUA_COMPAT_MAXN)
@@ -434,6 +456,8 @@ static const luaL_Reg tab_funcs[] = {
   {"remove", tremove},
   {"move", tmove},
   {"sort", sort},
+  {"new", tnew},
+  {"clear", tclear},
   {NULL, NULL}
 };
 
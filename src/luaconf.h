@@ -36,6 +36,43 @@
 /* #define LUA_32BITS */
 
 
+/*
+@@ LUA_NANBOXING packs each tagged value in 8 bytes, storing values
+** other than floats inside the NaN space of a 'double' (see lobject.h).
+** It implies 32-bit integers and 'double' floats, and needs a 64-bit
+** platform whose user addresses fit in 47 bits (eg. x86-64). Light
+** userdata keep only the low 47 bits of their pointers.
+*/
+/* #define LUA_NANBOXING */
+
+
+/*
+@@ LUA_USE_SWISSTABLE replaces the chained hash part of the tables by
+** an open-addressing one probed in groups of 16 positions, matched with
+** SSE2 when it is available (see ltable.c).
+*/
+/* #define LUA_USE_SWISSTABLE */
+
+
+/*
+@@ LUA_USE_BGSWEEP gives the memory freed by the sweep steps of the
+** collector back to the allocation function in a helper thread (see
+** lgc.c). It needs POSIX threads and a thread-safe allocation function
+** (the default one of the auxiliary library locks its pools then). Link
+** with the thread library: 'make linux THREADLIBS=-lpthread'.
+*/
+/* #define LUA_USE_BGSWEEP */
+
+
+/*
+@@ LUAL_NOPOOL makes the default allocation function of the auxiliary
+** library use plain 'realloc' and 'free' instead of its pools of small
+** blocks (see lauxlib.c). Non POSIX systems always do that, and so do
+** AddressSanitizer builds unless LUAL_USEPOOL is defined.
+*/
+/* #define LUAL_NOPOOL */
+
+
 /*
 @@ LUA_USE_C89 controls the use of non-ISO-C89 features.
 ** Define it if you want Lua to avoid the use of a few C99 features
@@ -126,6 +163,13 @@
 #endif
 #define LUA_FLOAT_TYPE	LUA_FLOAT_FLOAT
 
+#elif defined(LUA_NANBOXING)	/* }{ */
+/*
+** integers that fit in the payload of a boxed value
+*/
+#define LUA_INT_TYPE	LUA_INT_INT
+#define LUA_FLOAT_TYPE	LUA_FLOAT_DOUBLE
+
 #elif defined(LUA_C89_NUMBERS)	/* }{ */
 /*
 ** largest types available for C89 ('long' and 'double')
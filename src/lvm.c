@@ -660,7 +660,9 @@ static void pushclosure (lua_State *L, Proto *p, UpVal **encup, StkId base,
 void luaV_finishOp (lua_State *L) {
   CallInfo *ci = L->ci;
   StkId base = ci->u.l.base;
-  Instruction inst = *(ci->u.l.savedpc - 1);  /* interrupted instruction */
+  /* @@FastLua: interrupted instruction */
+  Instruction inst = fli_getoriginal(clLvalue(ci->func)->p,
+                                     (Instruction *)(ci->u.l.savedpc - 1));
   OpCode op = GET_OPCODE(inst);
   switch (op) {  /* finish its execution */
     case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_IDIV:
@@ -748,7 +750,8 @@ void luaV_finishOp (lua_State *L) {
 #define donextjump(ci)	{ i = *ci->u.l.savedpc; dojump(ci, i, 1); }
 
 
-#define Protect(x)	{ {x;}; base = ci->u.l.base; }
+/* @@FastLua: a call may start or stop the recording */
+#define Protect(x)	{ {x;}; base = ci->u.l.base; updatedisp(); }
 
 #define checkGC(L,c)  \
 	{ luaC_condGC(L, L->top = (c),  /* limit of live values */ \
@@ -771,6 +774,23 @@ void luaV_finishOp (lua_State *L) {
 #define vmbreak		break
 
 
+/*
+** @@FastLua: with a switch, the recording state is checked before each
+** fetch. Jump tables (see fl_jumptab.h) have a separate dispatch loop for
+** the recording, so the plain one has no check.
+*/
+#define vmrecord()	flrec_record(L, ci)
+#define updatedisp()	((void)0)
+
+#if !defined(LUA_USE_JUMPTABLE)
+#if defined(__GNUC__)
+#define LUA_USE_JUMPTABLE	1
+#else
+#define LUA_USE_JUMPTABLE	0
+#endif
+#endif
+
+
 /*
 ** copy of 'luaV_gettable', but protecting the call to potential
 ** metamethod (which can reallocate the stack)
@@ -780,6 +800,18 @@ void luaV_finishOp (lua_State *L) {
   else Protect(luaV_finishget(L,t,k,v,slot)); }
 
 
+/*
+** @@FastLua: 'gettableProtected' with a short string key, using the inline
+** cache of the current instruction
+*/
+#define gettableCached(L,t,k,v) { const TValue *slot; \
+  if (!ttistable(t)) { Protect(luaV_finishget(L,t,k,v,NULL)); } \
+  else { \
+    slot = flvm_cachedget(hvalue(t), tsvalue(k), flvm_gethint(cl->p, ci)); \
+    if (!ttisnil(slot)) { setobj2s(L, v, slot); } \
+    else Protect(luaV_finishget(L,t,k,v,slot)); } }
+
+
 /* same for 'luaV_settable' */
 #define settableProtected(L,t,k,v) { const TValue *slot; \
   if (!luaV_fastset(L,t,k,slot,luaH_get,v)) \
@@ -787,23 +819,33 @@ void luaV_finishOp (lua_State *L) {
 
 
 
+#if LUA_USE_JUMPTABLE
+/* @@FastLua: computed gotos are a GNU extension */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
 void luaV_execute (lua_State *L) {
   CallInfo *ci = L->ci;
   LClosure *cl;
   TValue *k;
   StkId base;
+#if LUA_USE_JUMPTABLE
+#include "fl_jumptab.h"
+#endif
   ci->callstatus |= CIST_FRESH;  /* fresh invocation of 'luaV_execute" */
  newframe:  /* reentry point when frame changes (call/return) */
   lua_assert(ci == L->ci);
   cl = clLvalue(ci->func);  /* local reference to function's closure */
   k = cl->p->k;  /* local reference to function's constant table */
   base = ci->u.l.base;  /* local copy of function's base */
+  updatedisp();  /* @@FastLua */
   /* main loop of interpreter */
   for (;;) {
     Instruction i;
     StkId ra;
     /* @@FastLua */
-    flrec_record(L, ci);
+    vmrecord();
     vmfetch();
     vmdispatch (GET_OPCODE(i)) {
       vmcase(OP_MOVE) {
@@ -842,12 +884,27 @@ void luaV_execute (lua_State *L) {
       vmcase(OP_GETTABUP) {
         TValue *upval = cl->upvals[GETARG_B(i)]->v;
         TValue *rc = RKC(i);
-        gettableProtected(L, upval, rc, ra);
+        if (ttisshrstring(rc)) {  /* @@FastLua */
+          gettableCached(L, upval, rc, ra);
+        }
+        else gettableProtected(L, upval, rc, ra);
         vmbreak;
       }
       vmcase(OP_GETTABLE) {
-        StkId rb = RB(i);
-        TValue *rc = RKC(i);
+        StkId rb;
+        TValue *rc;
+        l_gettable:
+        rb = RB(i);
+        rc = RKC(i);
+        if (ttisshrstring(rc)) {  /* @@FastLua */
+          gettableCached(L, rb, rc, ra);
+          vmbreak;
+        }
+        /* @@FastLua: quicken the accesses to the array part */
+        if (ttistable(rb) && ttisinteger(rc) &&
+            l_castS2U(ivalue(rc)) - 1u < hvalue(rb)->sizearray &&
+            !ttisnil(&hvalue(rb)->array[ivalue(rc) - 1]))
+          fli_quicken(ci, OP_GETARRAY);
         gettableProtected(L, rb, rc, ra);
         vmbreak;
       }
@@ -886,21 +943,30 @@ void luaV_execute (lua_State *L) {
         TValue *rc = RKC(i);
         TString *key = tsvalue(rc);  /* key must be a string */
         setobjs2s(L, ra + 1, rb);
-        if (luaV_fastget(L, rb, key, aux, luaH_getstr)) {
+        if (ttisshrstring(rc)) {  /* @@FastLua */
+          gettableCached(L, rb, rc, ra);
+        }
+        else if (luaV_fastget(L, rb, key, aux, luaH_getstr)) {
           setobj2s(L, ra, aux);
         }
         else Protect(luaV_finishget(L, rb, rc, ra, aux));
         vmbreak;
       }
       vmcase(OP_ADD) {
-        TValue *rb = RKB(i);
-        TValue *rc = RKC(i);
+        TValue *rb;
+        TValue *rc;
         lua_Number nb; lua_Number nc;
+        l_add:
+        rb = RKB(i);
+        rc = RKC(i);
         if (ttisinteger(rb) && ttisinteger(rc)) {
           lua_Integer ib = ivalue(rb); lua_Integer ic = ivalue(rc);
           setivalue(ra, intop(+, ib, ic));
+          fli_quicken(ci, OP_ADDII);  /* @@FastLua */
         }
         else if (tonumber(rb, &nb) && tonumber(rc, &nc)) {
+          if (ttisfloat(rb) && ttisfloat(rc))
+            fli_quicken(ci, OP_ADDFF);  /* @@FastLua */
           setfltvalue(ra, luai_numadd(L, nb, nc));
         }
         else { Protect(luaT_trybinTM(L, rb, rc, ra, TM_ADD)); }
@@ -1099,8 +1165,18 @@ void luaV_execute (lua_State *L) {
         vmbreak;
       }
       vmcase(OP_LT) {
+        TValue *rb;
+        TValue *rc;
+        l_lt:
+        rb = RKB(i);
+        rc = RKC(i);
+        /* @@FastLua */
+        if (ttisinteger(rb) && ttisinteger(rc))
+          fli_quicken(ci, OP_LTII);
+        else if (ttisfloat(rb) && ttisfloat(rc))
+          fli_quicken(ci, OP_LTFF);
         Protect(
-          if (luaV_lessthan(L, RKB(i), RKC(i)) != GETARG_A(i))
+          if (luaV_lessthan(L, rb, rc) != GETARG_A(i))
             ci->u.l.savedpc++;
           else
             donextjump(ci);
@@ -1247,13 +1323,19 @@ void luaV_execute (lua_State *L) {
         vmbreak;
       }
       vmcase(OP_TFORCALL) {
-        StkId cb = ra + 3;  /* call base */
+        StkId cb;
+        l_tforcall:
+        cb = ra + 3;  /* call base */
         setobjs2s(L, cb+2, ra+2);
         setobjs2s(L, cb+1, ra+1);
         setobjs2s(L, cb, ra);
         L->top = cb + 3;  /* func. + 2 args (state and index) */
         Protect(luaD_call(L, cb, GETARG_C(i)));
         L->top = ci->top;
+#ifdef FL_ENABLE
+        /* @@FastLua: the TFORLOOP may be recorded or replaced by a trace */
+        vmbreak;
+#endif
         i = *(ci->u.l.savedpc++);  /* go to next instruction */
         ra = RA(i);
         lua_assert(GET_OPCODE(i) == OP_TFORLOOP);
@@ -1321,14 +1403,93 @@ void luaV_execute (lua_State *L) {
         lua_assert(0);
         vmbreak;
       }
+      vmcase(OP_ADDII) {
+        /* @@FastLua: quickened opcodes, rewritten back on a type miss */
+        TValue *rb = RKB(i);
+        TValue *rc = RKC(i);
+        if (ttisinteger(rb) && ttisinteger(rc)) {
+          setivalue(ra, intop(+, ivalue(rb), ivalue(rc)));
+          vmbreak;
+        }
+        fli_quicken(ci, OP_ADD);
+        goto l_add;
+      }
+      vmcase(OP_ADDFF) {
+        TValue *rb = RKB(i);
+        TValue *rc = RKC(i);
+        if (ttisfloat(rb) && ttisfloat(rc)) {
+          setfltvalue(ra, luai_numadd(L, fltvalue(rb), fltvalue(rc)));
+          vmbreak;
+        }
+        fli_quicken(ci, OP_ADD);
+        goto l_add;
+      }
+      vmcase(OP_LTII) {
+        TValue *rb = RKB(i);
+        TValue *rc = RKC(i);
+        if (ttisinteger(rb) && ttisinteger(rc)) {
+          if ((ivalue(rb) < ivalue(rc)) != GETARG_A(i))
+            ci->u.l.savedpc++;
+          else
+            donextjump(ci);
+          vmbreak;
+        }
+        fli_quicken(ci, OP_LT);
+        goto l_lt;
+      }
+      vmcase(OP_LTFF) {
+        TValue *rb = RKB(i);
+        TValue *rc = RKC(i);
+        if (ttisfloat(rb) && ttisfloat(rc)) {
+          if (luai_numlt(fltvalue(rb), fltvalue(rc)) != GETARG_A(i))
+            ci->u.l.savedpc++;
+          else
+            donextjump(ci);
+          vmbreak;
+        }
+        fli_quicken(ci, OP_LT);
+        goto l_lt;
+      }
+      vmcase(OP_GETARRAY) {
+        StkId rb = RB(i);
+        TValue *rc = RKC(i);
+        if (ttistable(rb) && ttisinteger(rc)) {
+          Table *h = hvalue(rb);
+          lua_Unsigned idx = l_castS2U(ivalue(rc)) - 1u;
+          if (idx < h->sizearray && !ttisnil(&h->array[idx])) {
+            setobj2s(L, ra, &h->array[idx]);
+            vmbreak;
+          }
+        }
+        fli_quicken(ci, OP_GETTABLE);
+        goto l_gettable;
+      }
       vmcase(OP_FLVM) {
         /* @@FastLua */
         flvm_execute();
-        break;
+        updatedisp();  /* the recording may have started */
+        vmbreak;
+      }
+#if LUA_USE_JUMPTABLE
+      l_record: {
+        /* @@FastLua: the instruction was fetched, but not executed */
+        if (flrec_isrecording(L)) {
+          ci->u.l.savedpc--;
+          flrec_record_(L, ci);
+          i = *(ci->u.l.savedpc++);  /* the recorder may change it */
+          ra = RA(i);
+        }
+        updatedisp();
+        goto *disptab[GET_OPCODE(i)];
       }
+#endif
     }
   }
 }
 
+#if LUA_USE_JUMPTABLE
+#pragma GCC diagnostic pop
+#endif
+
 /* }================================================================== */
 